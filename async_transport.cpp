@@ -0,0 +1,331 @@
+#include "async_transport.h"
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <curl/curl.h>
+
+struct async_transport::request {
+  CURL* handle = nullptr;
+  curl_slist* headers = nullptr;
+  std::string url;
+  std::string body;
+  bool isPost = false;
+  mastodonpp::answer_type answer;
+  std::promise<mastodonpp::answer_type> promise;
+  char error[CURL_ERROR_SIZE] = {0};
+
+  ~request()
+  {
+    if (handle)
+    {
+      curl_easy_cleanup(handle);
+    }
+
+    curl_slist_free_all(headers);
+  }
+};
+
+namespace {
+
+  std::size_t writeBody(char* data, std::size_t size, std::size_t count, void* userdata)
+  {
+    static_cast<std::string*>(userdata)->append(data, size * count);
+
+    return size * count;
+  }
+
+  std::string escape(std::string_view text)
+  {
+    char* escaped = curl_easy_escape(nullptr, text.data(), text.size());
+    std::string result(escaped);
+    curl_free(escaped);
+
+    return result;
+  }
+
+  // Builds the query string or form body the same way mastodonpp does:
+  // lists become repeated key[]=value pairs.
+  std::string encodeParameters(const mastodonpp::parametermap& parameters)
+  {
+    std::string result;
+
+    auto append = [&] (std::string_view key, std::string_view value) {
+      if (!result.empty())
+      {
+        result += '&';
+      }
+
+      result += escape(key);
+      result += '=';
+      result += escape(value);
+    };
+
+    for (const auto& [key, value] : parameters)
+    {
+      if (key == "id")
+      {
+        // Goes into the path instead.
+        continue;
+      }
+
+      if (std::holds_alternative<std::string_view>(value))
+      {
+        append(key, std::get<std::string_view>(value));
+      } else {
+        std::string listKey = std::string(key) + "[]";
+        for (std::string_view item : std::get<std::vector<std::string_view>>(value))
+        {
+          append(listKey, item);
+        }
+      }
+    }
+
+    return result;
+  }
+
+  std::string buildPath(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters)
+  {
+    std::string path(mastodonpp::API{endpoint}.to_string_view());
+
+    std::string::size_type placeholder = path.find("<ID>");
+    if (placeholder != std::string::npos)
+    {
+      auto id = parameters.find("id");
+      if (id != std::end(parameters)
+        && std::holds_alternative<std::string_view>(id->second))
+      {
+        path.replace(
+          placeholder,
+          4,
+          escape(std::get<std::string_view>(id->second)));
+      }
+    }
+
+    return path;
+  }
+
+}
+
+async_transport::async_transport(
+  const std::string& instance,
+  const std::string& accessToken,
+  std::size_t maxInFlight) :
+    baseUrl_(instance.find("://") == std::string::npos
+      ? "https://" + instance
+      : instance),
+    authorization_("Authorization: Bearer " + accessToken),
+    maxInFlight_(maxInFlight > 0 ? maxInFlight : 1)
+{
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  CURLM* multi = curl_multi_init();
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(maxInFlight_));
+  curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, static_cast<long>(maxInFlight_));
+  multi_ = multi;
+
+  thread_ = std::thread(&async_transport::run, this);
+}
+
+async_transport::~async_transport()
+{
+  running_ = false;
+  curl_multi_wakeup(static_cast<CURLM*>(multi_));
+
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+
+  curl_multi_cleanup(static_cast<CURLM*>(multi_));
+  curl_global_cleanup();
+}
+
+mastodonpp::answer_type async_transport::get(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return submit(false, endpoint, parameters).get();
+}
+
+mastodonpp::answer_type async_transport::post(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return submit(true, endpoint, parameters).get();
+}
+
+std::future<mastodonpp::answer_type> async_transport::getAsync(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return submit(false, endpoint, parameters);
+}
+
+std::future<mastodonpp::answer_type> async_transport::postAsync(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return submit(true, endpoint, parameters);
+}
+
+std::future<mastodonpp::answer_type> async_transport::submit(
+  bool isPost,
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  auto req = std::make_unique<request>();
+  req->isPost = isPost;
+  req->url = baseUrl_ + buildPath(endpoint, parameters);
+
+  std::string encoded = encodeParameters(parameters);
+  if (isPost)
+  {
+    req->body = std::move(encoded);
+  } else if (!encoded.empty())
+  {
+    req->url += "?" + encoded;
+  }
+
+  std::future<mastodonpp::answer_type> result = req->promise.get_future();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(req));
+  }
+
+  curl_multi_wakeup(static_cast<CURLM*>(multi_));
+
+  return result;
+}
+
+void async_transport::run()
+{
+  CURLM* multi = static_cast<CURLM*>(multi_);
+
+  while (running_)
+  {
+    startQueued();
+
+    int stillRunning = 0;
+    curl_multi_perform(multi, &stillRunning);
+
+    int pending = 0;
+    while (CURLMsg* message = curl_multi_info_read(multi, &pending))
+    {
+      if (message->msg == CURLMSG_DONE)
+      {
+        finish(message->easy_handle, message->data.result);
+      }
+    }
+
+    curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+
+  // Whatever is left will never be sent.
+  for (auto& [handle, req] : active_)
+  {
+    curl_multi_remove_handle(multi, handle);
+    req->answer.curl_error_code = CURLE_ABORTED_BY_CALLBACK;
+    req->answer.error_message = "Transport shut down";
+    req->promise.set_value(std::move(req->answer));
+  }
+
+  active_.clear();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& req : queue_)
+  {
+    req->answer.curl_error_code = CURLE_ABORTED_BY_CALLBACK;
+    req->answer.error_message = "Transport shut down";
+    req->promise.set_value(std::move(req->answer));
+  }
+
+  queue_.clear();
+}
+
+void async_transport::startQueued()
+{
+  CURLM* multi = static_cast<CURLM*>(multi_);
+
+  while (active_.size() < maxInFlight_)
+  {
+    std::unique_ptr<request> req;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queue_.empty())
+      {
+        return;
+      }
+
+      req = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    CURL* handle = curl_easy_init();
+    req->handle = handle;
+
+    req->headers = curl_slist_append(req->headers, authorization_.c_str());
+
+    curl_easy_setopt(handle, CURLOPT_URL, req->url.c_str());
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, req->headers);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &writeBody);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &req->answer.body);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, &writeBody);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, &req->answer.headers);
+    curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, req->error);
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT, 120L);
+
+    if (req->isPost)
+    {
+      curl_easy_setopt(handle, CURLOPT_POST, 1L);
+      curl_easy_setopt(handle, CURLOPT_POSTFIELDS, req->body.c_str());
+      curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(req->body.size()));
+    }
+
+    curl_multi_add_handle(multi, handle);
+    active_[handle] = std::move(req);
+  }
+}
+
+void async_transport::finish(void* handle, int result)
+{
+  auto it = active_.find(handle);
+  if (it == std::end(active_))
+  {
+    return;
+  }
+
+  std::unique_ptr<request> req = std::move(it->second);
+  active_.erase(it);
+
+  curl_multi_remove_handle(static_cast<CURLM*>(multi_), handle);
+
+  if (result != CURLE_OK)
+  {
+    req->answer.curl_error_code = static_cast<std::uint8_t>(result);
+    req->answer.error_message = req->error[0]
+      ? req->error
+      : curl_easy_strerror(static_cast<CURLcode>(result));
+  } else {
+    long status = 0;
+    curl_easy_getinfo(req->handle, CURLINFO_RESPONSE_CODE, &status);
+    req->answer.http_status = static_cast<std::uint16_t>(status);
+
+    char* contentType = nullptr;
+    curl_easy_getinfo(req->handle, CURLINFO_CONTENT_TYPE, &contentType);
+    if (contentType)
+    {
+      req->answer.content_type = contentType;
+    }
+  }
+
+  req->promise.set_value(std::move(req->answer));
+}
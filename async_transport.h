@@ -0,0 +1,80 @@
+#ifndef ASYNC_TRANSPORT_H_E6B0473A
+#define ASYNC_TRANSPORT_H_E6B0473A
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "transport.h"
+
+// Sends requests to a live instance through a libcurl multi handle on a
+// background thread. Connections to the instance are kept alive and reused
+// (multiplexed over HTTP/2 where the server supports it), and up to
+// maxInFlight requests run at the same time; anything beyond that waits in
+// a queue. The instance may be given with a scheme (e.g. to talk to a
+// local stand-in server over plain HTTP); otherwise HTTPS is used.
+class async_transport : public transport {
+public:
+
+  async_transport(
+    const std::string& instance,
+    const std::string& accessToken,
+    std::size_t maxInFlight);
+
+  async_transport(const async_transport&) = delete;
+  async_transport& operator=(const async_transport&) = delete;
+
+  ~async_transport();
+
+  mastodonpp::answer_type get(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  mastodonpp::answer_type post(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  std::future<mastodonpp::answer_type> getAsync(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  std::future<mastodonpp::answer_type> postAsync(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+private:
+
+  struct request;
+
+  std::future<mastodonpp::answer_type> submit(
+    bool isPost,
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters);
+
+  void run();
+
+  void startQueued();
+
+  void finish(void* handle, int result);
+
+  const std::string baseUrl_;
+  const std::string authorization_;
+  const std::size_t maxInFlight_;
+
+  void* multi_ = nullptr;
+  std::thread thread_;
+  std::atomic<bool> running_ {true};
+
+  std::mutex mutex_;
+  std::deque<std::unique_ptr<request>> queue_;
+
+  // Only touched by the worker thread.
+  std::map<void*, std::unique_ptr<request>> active_;
+};
+
+#endif /* end of include guard: ASYNC_TRANSPORT_H_E6B0473A */
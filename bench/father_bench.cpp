@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <verbly.h>
+#include "lexicon.h"
+#include "replier.h"
+#include "request_scheduler.h"
+#include "timeline.h"
+#include "trigger_matcher.h"
+#include "transport.h"
+
+// Every heap allocation in the process is counted, so the difference across
+// one post is the number of allocations that post cost.
+std::atomic<unsigned long long> allocations {0};
+
+void* operator new(std::size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+
+  if (void* result = std::malloc(size ? size : 1))
+  {
+    return result;
+  }
+
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+const int LEXICON_CACHE_SIZE = 4096;
+
+int main(int argc, char** argv)
+{
+  if (argc < 3 || argc > 4)
+  {
+    std::cout << "usage: father_bench [verbly datafile] [recording] [rounds]"
+      << std::endl;
+    return -1;
+  }
+
+  std::string recording(argv[2]);
+  int rounds = (argc == 4) ? std::atoi(argv[3]) : 10;
+
+  verbly::database database(argv[1]);
+  lexicon words(database, LEXICON_CACHE_SIZE);
+
+  // A fixed seed makes every run reply to the same posts.
+  std::mt19937 rng(0);
+  trigger_matcher triggers;
+  replier dad(words, rng, triggers);
+
+  std::vector<double> latencies;
+  unsigned long long postAllocations = 0;
+  unsigned long long replies = 0;
+
+  // Read once up front; the file I/O is not part of what is measured.
+  replay_transport replay(recording);
+
+  auto benchStart = std::chrono::steady_clock::now();
+
+  for (int round = 0; round < rounds; round++)
+  {
+    replay.rewind();
+    request_scheduler scheduler(replay, false);
+    timeline home_timeline(mastodonpp::API::v1::timelines_home);
+
+    // Quiet polls and recorded errors return no posts, so run until the
+    // recorded timeline pages are used up rather than until a poll comes
+    // back empty.
+    while (replay.remaining("GET", mastodonpp::API::v1::timelines_home) > 0)
+    {
+      std::vector<post> posts = home_timeline.poll(scheduler);
+
+      for (const post& status : posts)
+      {
+        if (status.reblog)
+        {
+          continue;
+        }
+
+        unsigned long long allocationsBefore = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+
+        std::string result = dad.respond(status);
+        if (!result.empty())
+        {
+          mastodonpp::parametermap parameters{
+            {"status", result},
+            {"in_reply_to_id", status.id}};
+
+          scheduler.post(
+            mastodonpp::API::v1::statuses,
+            parameters,
+            request_priority::reply);
+
+          replies++;
+        }
+
+        std::chrono::duration<double, std::micro> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+        latencies.push_back(elapsed.count());
+        postAllocations += allocations.load() - allocationsBefore;
+      }
+    }
+  }
+
+  std::chrono::duration<double> total =
+    std::chrono::steady_clock::now() - benchStart;
+
+  if (latencies.empty())
+  {
+    std::cout << "The recording contains no timeline posts." << std::endl;
+    return 1;
+  }
+
+  std::sort(std::begin(latencies), std::end(latencies));
+
+  auto percentile = [&] (double p) {
+    return latencies[static_cast<std::size_t>(p * (latencies.size() - 1))];
+  };
+
+  std::cout << "posts:            " << latencies.size() << std::endl;
+  std::cout << "replies:          " << replies << std::endl;
+  std::cout << "posts/sec:        " << latencies.size() / total.count()
+    << std::endl;
+  std::cout << "p50 latency (us): " << percentile(0.50) << std::endl;
+  std::cout << "p99 latency (us): " << percentile(0.99) << std::endl;
+  std::cout << "allocs/post:      "
+    << static_cast<double>(postAllocations) / latencies.size() << std::endl;
+  std::cout << "lexicon cache:    " << words.getHits() << " hits, "
+    << words.getMisses() << " misses" << std::endl;
+}
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "id_set.h"
+
+// Snowflake-like IDs: a millisecond timestamp in the high bits and a
+// sequence in the low 16, which is what Mastodon hands out.
+std::vector<std::uint64_t> makeIds(std::mt19937_64& rng, std::size_t count)
+{
+  std::uniform_int_distribution<std::uint64_t> time(
+    1500000000000ull,
+    1800000000000ull);
+  std::uniform_int_distribution<std::uint64_t> sequence(0, 0xFFFF);
+
+  std::vector<std::uint64_t> ids;
+  for (std::size_t i = 0; i < count; i++)
+  {
+    ids.push_back((time(rng) << 16) | sequence(rng));
+  }
+
+  return ids;
+}
+
+template <typename F>
+double measure(int rounds, F&& f)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  for (int r = 0; r < rounds; r++)
+  {
+    f();
+  }
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  return elapsed.count() / rounds;
+}
+
+int main()
+{
+  std::mt19937_64 rng(1234);
+  const std::size_t count = 100000;
+  const int rounds = 10;
+
+  // Following and followers overlap mostly, like a bot that follows back.
+  std::vector<std::uint64_t> followers = makeIds(rng, count);
+  std::vector<std::uint64_t> following(
+    std::begin(followers),
+    std::begin(followers) + count * 9 / 10);
+  std::vector<std::uint64_t> extra = makeIds(rng, count / 10);
+  following.insert(std::end(following), std::begin(extra), std::end(extra));
+
+  // Half of the lookups hit, like a timeline of mostly friends.
+  std::vector<std::uint64_t> lookups = makeIds(rng, count / 2);
+  lookups.insert(
+    std::end(lookups),
+    std::begin(following),
+    std::begin(following) + count / 2);
+  std::shuffle(std::begin(lookups), std::end(lookups), rng);
+
+  std::vector<std::string> lookupText;
+  for (std::uint64_t id : lookups)
+  {
+    lookupText.push_back(std::to_string(id));
+  }
+
+  std::size_t sink = 0;
+
+  // The std::set<std::string> representation the follower code used to
+  // have, as the baseline.
+  std::set<std::string> legacyFollowers;
+  std::set<std::string> legacyFollowing;
+
+  double legacyBuild = measure(rounds, [&] {
+    legacyFollowers.clear();
+    legacyFollowing.clear();
+
+    for (std::uint64_t id : followers)
+    {
+      legacyFollowers.insert(std::to_string(id));
+    }
+
+    for (std::uint64_t id : following)
+    {
+      legacyFollowing.insert(std::to_string(id));
+    }
+  });
+
+  double legacyLookup = measure(rounds, [&] {
+    for (const std::string& id : lookupText)
+    {
+      sink += legacyFollowing.count(id);
+    }
+  });
+
+  double legacyDiff = measure(rounds, [&] {
+    std::set<std::string> unfollows;
+    std::set_difference(
+      std::begin(legacyFollowing),
+      std::end(legacyFollowing),
+      std::begin(legacyFollowers),
+      std::end(legacyFollowers),
+      std::inserter(unfollows, std::begin(unfollows)));
+
+    std::set<std::string> follows;
+    std::set_difference(
+      std::begin(legacyFollowers),
+      std::end(legacyFollowers),
+      std::begin(legacyFollowing),
+      std::end(legacyFollowing),
+      std::inserter(follows, std::begin(follows)));
+
+    sink += unfollows.size() + follows.size();
+  });
+
+  id_set currentFollowers;
+  id_set currentFollowing;
+
+  double currentBuild = measure(rounds, [&] {
+    currentFollowers = id_set(followers);
+    currentFollowing = id_set(following);
+  });
+
+  // Timeline posts carry the account ID as a string, so parsing is part of
+  // the cost of a lookup.
+  double currentLookup = measure(rounds, [&] {
+    for (const std::string& text : lookupText)
+    {
+      std::uint64_t id;
+      sink += parseId(text, id) && currentFollowing.contains(id);
+    }
+  });
+
+  double currentDiff = measure(rounds, [&] {
+    id_set unfollows = currentFollowing.difference(currentFollowers);
+    id_set follows = currentFollowers.difference(currentFollowing);
+
+    sink += unfollows.size() + follows.size();
+  });
+
+  auto report = [] (const char* name, double legacy, double current) {
+    std::cout << name << ": std::set<std::string> " << (legacy * 1000)
+      << " ms, id_set " << (current * 1000) << " ms ("
+      << (legacy / current) << "x)" << std::endl;
+  };
+
+  std::cout << count << " IDs" << std::endl;
+  report("build", legacyBuild, currentBuild);
+  report(
+    (std::to_string(lookups.size()) + " lookups").c_str(),
+    legacyLookup,
+    currentLookup);
+  report("both differences", legacyDiff, currentDiff);
+  std::cout << "[" << sink << "]" << std::endl;
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <hkutil/string.h>
+#include "normalizer.h"
+
+// The tag stripping and canonicalization that father.cpp used before the
+// normalizer existed, kept here as the baseline.
+std::vector<std::string> legacyCanonicalize(std::string post_content)
+{
+  std::string::size_type pos;
+  while ((pos = post_content.find("<")) != std::string::npos)
+  {
+    std::string prefix = post_content.substr(0, pos);
+    std::string rest = post_content.substr(pos);
+    std::string::size_type right_pos = rest.find(">");
+    if (right_pos == std::string::npos) {
+      post_content = prefix;
+    } else {
+      post_content = prefix + rest.substr(right_pos);
+    }
+  }
+
+  std::vector<std::string> tokens =
+    hatkirby::split<std::vector<std::string>>(post_content, " ");
+
+  std::vector<std::string> canonical;
+  for (std::string token : tokens)
+  {
+    std::string canonStr;
+    for (char ch : token)
+    {
+      if (std::isalpha(static_cast<unsigned char>(ch)))
+      {
+        canonStr += std::tolower(ch);
+      }
+    }
+
+    canonical.push_back(canonStr);
+  }
+
+  return canonical;
+}
+
+std::vector<std::string> makePosts(std::mt19937& rng, int count, int paragraphs)
+{
+  const std::vector<std::string> words = {
+    "I&#39;m", "really", "hungry", "today", "and", "the", "weather", "is",
+    "<a href=\"https://example.com/@someone\" class=\"u-url mention\">@<span>someone</span></a>",
+    "<a href=\"https://example.com/tags/dad\" class=\"mention hashtag\" rel=\"tag\">#<span>dad</span></a>",
+    "café", "I’m", "tired", "of", "this", "&amp;", "jokes", "😀", "extraordinarily"};
+
+  std::uniform_int_distribution<int> pick(0, words.size() - 1);
+  std::uniform_int_distribution<int> length(8, 40);
+
+  std::vector<std::string> posts;
+  for (int i = 0; i < count; i++)
+  {
+    std::string post;
+    for (int p = 0; p < paragraphs; p++)
+    {
+      post += "<p>";
+
+      int n = length(rng);
+      for (int w = 0; w < n; w++)
+      {
+        if (w > 0)
+        {
+          post += (w % 7 == 0) ? "<br />" : " ";
+        }
+
+        post += words[pick(rng)];
+      }
+
+      post += "</p>";
+    }
+
+    posts.push_back(std::move(post));
+  }
+
+  return posts;
+}
+
+template <typename F>
+double measure(const std::vector<std::string>& posts, int rounds, F&& f)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  for (int r = 0; r < rounds; r++)
+  {
+    for (const std::string& post : posts)
+    {
+      f(post);
+    }
+  }
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  return (posts.size() * rounds) / elapsed.count();
+}
+
+int main()
+{
+  std::mt19937 rng(1234);
+  const int rounds = 20;
+
+  for (int paragraphs : {1, 4, 16})
+  {
+    std::vector<std::string> posts = makePosts(rng, 2000, paragraphs);
+
+    std::size_t sink = 0;
+
+    double legacy = measure(posts, rounds, [&] (const std::string& post) {
+      std::vector<std::string> canonical = legacyCanonicalize(post);
+      sink += std::count(std::begin(canonical), std::end(canonical), "im");
+    });
+
+    normalizer postNormalizer;
+    double current = measure(posts, rounds, [&] (const std::string& post) {
+      const std::vector<std::string_view>& canonical =
+        postNormalizer.normalize(post);
+      sink += std::count(std::begin(canonical), std::end(canonical), "im");
+    });
+
+    std::cout << paragraphs << " paragraph(s): legacy " << legacy
+      << " posts/s, normalizer " << current << " posts/s ("
+      << (current / legacy) << "x)" << " [" << sink << "]" << std::endl;
+  }
+}
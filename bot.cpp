@@ -0,0 +1,494 @@
+#include "bot.h"
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <future>
+#include <vector>
+#include <json.hpp>
+#include "async_transport.h"
+#include "metrics.h"
+#include "state_file.h"
+
+// Streamed posts are picked up this often.
+const std::chrono::seconds STREAM_CHECK_EVERY {5};
+
+// Follow back new followers every 5 minutes.
+const std::chrono::minutes CHECK_FOLLOWERS_EVERY {5};
+
+// Unfollows are not notified, so fully resync the lists once a day.
+const std::chrono::hours RECONCILE_FOLLOWERS_EVERY {24};
+
+// A resync fetches a few pages per run, and runs this often until it is
+// done.
+const std::chrono::seconds RECONCILE_STEP_EVERY {10};
+
+// Streaming bots run every few seconds, which is too often to rewrite the
+// state file each time.
+const std::chrono::minutes SAVE_STATE_EVERY {1};
+
+namespace {
+
+  std::unique_ptr<transport> makeLiveTransport(
+    const bot_config& config,
+    mastodonpp::Connection& connection)
+  {
+    if (config.maxInFlight > 0)
+    {
+      return std::make_unique<async_transport>(
+        config.instance,
+        config.token,
+        config.maxInFlight);
+    }
+
+    return std::make_unique<connection_transport>(connection);
+  }
+
+  std::unique_ptr<recording_transport> makeRecorder(
+    transport& inner,
+    const std::string& path)
+  {
+    if (path.empty())
+    {
+      return {};
+    }
+
+    return std::make_unique<recording_transport>(inner, path);
+  }
+
+}
+
+bot::bot(
+  bot_config config) :
+    config_(std::move(config)),
+    name_(config_.instance),
+    instance_(config_.instance, config_.token),
+    connection_(instance_),
+    liveTransport_(makeLiveTransport(config_, connection_)),
+    recorder_(makeRecorder(*liveTransport_, config_.recordFile)),
+    scheduler_(recorder_
+      ? static_cast<transport&>(*recorder_)
+      : *liveTransport_),
+    homeTimeline_(mastodonpp::API::v1::timelines_home),
+    replied_(config_.dedupCapacity, config_.dedupFalsePositiveRate)
+{
+}
+
+bool bot::start()
+{
+  nlohmann::json account_details;
+  {
+    const mastodonpp::parametermap parameters {};
+    auto answer = scheduler_.get(mastodonpp::API::v1::accounts_verify_credentials, parameters);
+    if (!answer)
+    {
+      if (answer.curl_error_code == 0)
+      {
+        std::cout << "HTTP status: " << answer.http_status << std::endl;
+      }
+      else
+      {
+        std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
+             << ": " << answer.error_message << std::endl;
+      }
+      return false;
+    }
+    std::cout << answer.body << std::endl;
+    account_details = nlohmann::json::parse(answer.body);
+  }
+
+  name_ = account_details["acct"].get<std::string>() + "@" + config_.instance;
+
+  relationships_ = std::make_unique<follow_sync>(
+    account_details["id"].get<std::string>());
+
+  bot_state savedState;
+  bool hasSavedState = false;
+  if (!config_.statePath.empty())
+  {
+    hasSavedState = loadState(config_.statePath, savedState);
+  }
+
+  if (hasSavedState && savedState.timelineSinceId != 0)
+  {
+    // Resume from the last post the previous run saw.
+    homeTimeline_.advance(savedState.timelineSinceId);
+  } else {
+    homeTimeline_.poll(scheduler_); // just ignore the results
+  }
+
+  if (hasSavedState)
+  {
+    replied_.restore(savedState.repliedIds);
+  }
+
+  if (hasSavedState && savedState.lastReconcile != 0)
+  {
+    relationships_->restore(savedState);
+
+    // Carry the age of the last full sync over, so a restart does not
+    // trigger a new one.
+    auto age = std::chrono::system_clock::now()
+      - std::chrono::system_clock::from_time_t(savedState.lastReconcile);
+
+    reconciledAt_ = savedState.lastReconcile;
+    lastReconcile_ = clock::now()
+      - std::chrono::duration_cast<clock::duration>(age);
+    followersSynced_ = true;
+  }
+
+  if (config_.streaming)
+  {
+    std::string streamingUrl = config_.streamingUrl;
+    if (streamingUrl.empty())
+    {
+      streamingUrl = "https://" + config_.instance + "/api/v1/streaming/user";
+    }
+
+    stream_ = std::make_unique<timeline_stream>(streamingUrl, config_.token);
+    stream_->start();
+  }
+
+  return true;
+}
+
+std::chrono::steady_clock::time_point bot::fetch(std::vector<post>& posts)
+{
+  static metrics::histogram& cycleTime = metrics::getHistogram(
+    "father_cycle_seconds",
+    "Time spent on one run of a bot");
+
+  metrics::timer cycleTimer(cycleTime);
+
+  clock::time_point now = clock::now();
+
+  syncFollowers(now);
+
+  // Until the first follower sync finishes every post would be dropped as
+  // not coming from a friend, so the timeline is left where it is (and the
+  // stream keeps buffering) until then. A later resync can also wake the
+  // bot up before the timeline is due.
+  if (followersSynced_ && (stream_ || now >= nextPoll_))
+  {
+    nextPoll_ = now + pollSchedule_.getInterval();
+
+    try
+    {
+      collectPosts(posts);
+
+      // Only posts newer than the last poll say anything about how busy
+      // the timeline is; backlog from a gap does not.
+      if (!stream_ && !homeTimeline_.didLastPollFail())
+      {
+        nextPoll_ = now + pollSchedule_.update(
+          now,
+          homeTimeline_.getLastNewPosts(),
+          homeTimeline_.isCatchingUp());
+      }
+    } catch (const std::exception& error)
+    {
+      // Rate limits are waited out by the scheduler, so anything that ends
+      // up here is not worth stalling the loop over.
+      std::cout << "Error while processing timeline for " << name_ << ": "
+        << error.what() << std::endl;
+    }
+  }
+
+  // Follow and unfollow with whatever budget the replies left over.
+  relationships_->drain(scheduler_);
+
+  save(now);
+
+  clock::time_point next = stream_ ? now + STREAM_CHECK_EVERY : nextPoll_;
+  if (!followersSynced_)
+  {
+    next = now + RECONCILE_STEP_EVERY;
+  } else if (relationships_->isReconciling())
+  {
+    next = std::min(next, now + RECONCILE_STEP_EVERY);
+  }
+
+  return next;
+}
+
+void bot::flush()
+{
+  save(clock::now(), true);
+}
+
+void bot::stop()
+{
+  scheduler_.stop();
+}
+
+void bot::syncFollowers(clock::time_point now)
+{
+  static metrics::histogram& reconcileTime = metrics::getHistogram(
+    "father_follower_reconcile_seconds",
+    "Time spent on one step of a follower reconciliation");
+  static metrics::histogram& updateTime = metrics::getHistogram(
+    "father_follower_update_seconds",
+    "Time spent checking follow notifications");
+
+  if (!followersSynced_
+    || relationships_->isReconciling()
+    || now - lastReconcile_ >= RECONCILE_FOLLOWERS_EVERY)
+  {
+    // Sync friends with followers, a few pages at a time so that other bots
+    // are not held up.
+    try
+    {
+      metrics::timer reconcileTimer(reconcileTime);
+
+      if (relationships_->reconcile(scheduler_))
+      {
+        lastReconcile_ = now;
+        lastFollowerSync_ = now;
+        reconciledAt_ = std::time(nullptr);
+        followersSynced_ = true;
+      }
+    } catch (const std::exception& error)
+    {
+      std::cout << "Error while syncing followers for " << name_ << ": "
+        << error.what() << std::endl;
+    }
+  } else if (now - lastFollowerSync_ >= CHECK_FOLLOWERS_EVERY)
+  {
+    try
+    {
+      metrics::timer updateTimer(updateTime);
+
+      relationships_->update(scheduler_);
+    } catch (const std::exception& error)
+    {
+      std::cout << "Error while checking for new followers for " << name_
+        << ": " << error.what() << std::endl;
+    }
+
+    lastFollowerSync_ = now;
+  }
+}
+
+void bot::collectPosts(std::vector<post>& posts)
+{
+  static metrics::counter& seen = metrics::getCounter(
+    "father_posts_seen_total",
+    "Posts taken from the timeline or stream");
+  static metrics::counter& notFriend = metrics::getCounter(
+    "father_posts_not_friend_total",
+    "Posts skipped because the author is not followed back");
+  static metrics::counter& reblogs = metrics::getCounter(
+    "father_posts_reblog_total",
+    "Posts skipped because they are reblogs");
+
+  std::vector<post> found;
+
+  if (stream_)
+  {
+    found = stream_->wait(std::chrono::milliseconds(0));
+
+    std::vector<post> missed;
+    bool reconnected = stream_->takeReconnected();
+    if (reconnected || homeTimeline_.isCatchingUp())
+    {
+      // Catch up on anything posted while the stream was down. A long
+      // outage can take several rounds.
+      missed = homeTimeline_.poll(scheduler_);
+
+      if (reconnected)
+      {
+        backfilled_.clear();
+      }
+
+      std::vector<std::uint64_t> ids(
+        std::begin(backfilled_),
+        std::end(backfilled_));
+      for (const post& status : missed)
+      {
+        std::uint64_t id;
+        if (parseId(status.id, id))
+        {
+          ids.push_back(id);
+        }
+      }
+
+      backfilled_ = id_set(std::move(ids));
+    }
+
+    found.erase(
+      std::remove_if(
+        std::begin(found),
+        std::end(found),
+        [&] (const post& status) {
+          std::uint64_t id;
+          return parseId(status.id, id) && backfilled_.contains(id);
+        }),
+      std::end(found));
+
+    for (const post& status : found)
+    {
+      std::uint64_t id;
+      if (parseId(status.id, id))
+      {
+        homeTimeline_.advance(id);
+      }
+    }
+
+    found.insert(
+      std::end(found),
+      std::make_move_iterator(std::begin(missed)),
+      std::make_move_iterator(std::end(missed)));
+  } else {
+    // Poll the timeline.
+    found = homeTimeline_.poll(scheduler_);
+  }
+
+  seen.add(found.size());
+
+  for (post& status : found)
+  {
+    std::uint64_t accountId;
+    if (!parseId(status.accountId, accountId)
+      || !relationships_->isFriend(accountId))
+    {
+      // Only monitor people you are following
+      notFriend.add();
+    } else if (status.reblog)
+    {
+      // Ignore retweets
+      reblogs.add();
+    } else {
+      posts.push_back(std::move(status));
+    }
+  }
+}
+
+void bot::sendReplies(const std::vector<pending_reply>& replies)
+{
+  static metrics::counter& repliesPosted = metrics::getCounter(
+    "father_replies_total",
+    "Replies posted");
+  static metrics::counter& failures = metrics::getCounter(
+    "father_reply_failures_total",
+    "Replies the instance did not accept");
+  static metrics::counter& duplicates = metrics::getCounter(
+    "father_replies_duplicate_total",
+    "Replies not sent because the status was already replied to");
+  static metrics::histogram& replyTime = metrics::getHistogram(
+    "father_reply_post_seconds",
+    "Time from sending a reply until the instance accepted it");
+
+  struct in_flight {
+    const pending_reply& reply;
+    clock::time_point sent;
+    std::future<mastodonpp::answer_type> answer;
+  };
+
+  // Every reply is sent before any is waited on, so a slow reply does not
+  // hold up the rest of the batch.
+  std::vector<in_flight> sending;
+
+  for (const pending_reply& reply : replies)
+  {
+    std::uint64_t id;
+    if (parseId(reply.inReplyTo, id))
+    {
+      std::lock_guard<std::mutex> lock(repliedMutex_);
+
+      if (replied_.contains(id))
+      {
+        duplicates.add();
+
+        continue;
+      }
+
+      // Remembered as soon as it is sent, so a duplicate later in the same
+      // batch is caught too. A reply that fails is only sent again when it
+      // certainly did not go through, so it is never posted twice.
+      replied_.insert(id);
+    }
+
+    mastodonpp::parametermap parameters{
+      {"status", reply.text},
+      {"in_reply_to_id", reply.inReplyTo}};
+
+    sending.push_back({
+      reply,
+      clock::now(),
+      scheduler_.postAsync(
+        mastodonpp::API::v1::statuses,
+        parameters,
+        request_priority::reply)});
+  }
+
+  for (in_flight& pending : sending)
+  {
+    auto answer = pending.answer.get();
+
+    if (canResendPost(answer))
+    {
+      // Overlapped requests are not retried, so resend through a blocking
+      // post that is. Anything else may already have been posted.
+      mastodonpp::parametermap parameters{
+        {"status", pending.reply.text},
+        {"in_reply_to_id", pending.reply.inReplyTo}};
+
+      answer = scheduler_.post(
+        mastodonpp::API::v1::statuses,
+        parameters,
+        request_priority::reply);
+    }
+
+    replyTime.observe(clock::now() - pending.sent);
+
+    if (answer)
+    {
+      repliesPosted.add();
+    }
+    else
+    {
+      failures.add();
+
+      if (answer.curl_error_code == 0)
+      {
+        std::cout << "HTTP status: " << answer.http_status << std::endl;
+      }
+      else
+      {
+        std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
+             << ": " << answer.error_message << std::endl;
+      }
+    }
+  }
+}
+
+void bot::save(clock::time_point now, bool force)
+{
+  if (config_.statePath.empty()
+    || !followersSynced_
+    || (!force && now - lastSave_ < SAVE_STATE_EVERY))
+  {
+    return;
+  }
+
+  bot_state state;
+  state.timelineSinceId = homeTimeline_.getSinceId();
+  state.lastReconcile = reconciledAt_;
+  relationships_->store(state);
+
+  {
+    std::lock_guard<std::mutex> lock(repliedMutex_);
+
+    state.repliedIds = replied_.getIds();
+  }
+
+  try
+  {
+    saveState(config_.statePath, state);
+
+    lastSave_ = now;
+  } catch (const std::exception& error)
+  {
+    std::cout << "Error while saving state for " << name_ << ": "
+      << error.what() << std::endl;
+  }
+}
@@ -0,0 +1,121 @@
+#ifndef BOT_H_A7E25C93
+#define BOT_H_A7E25C93
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <mastodonpp/mastodonpp.hpp>
+#include "follow_sync.h"
+#include "id_set.h"
+#include "poll_schedule.h"
+#include "post.h"
+#include "replied_filter.h"
+#include "request_scheduler.h"
+#include "timeline.h"
+#include "timeline_stream.h"
+#include "transport.h"
+
+struct bot_config {
+  std::string instance;
+  std::string token;
+  std::string statePath;
+  bool streaming = false;
+  std::string streamingUrl;
+  std::string recordFile;
+
+  // When non-zero, requests go through a libcurl multi handle with up to
+  // this many in flight instead of mastodonpp's blocking connection.
+  std::size_t maxInFlight = 0;
+
+  // How many replied statuses are remembered to avoid replying twice, and
+  // how often an unrelated status may be mistaken for one of them.
+  std::size_t dedupCapacity = 10000;
+  double dedupFalsePositiveRate = 0.001;
+};
+
+struct pending_reply {
+  std::string text;
+  std::string inReplyTo;
+};
+
+// One Mastodon account served by this process. Everything specific to the
+// account (connection, timeline cursor, friend set) lives here; deciding on
+// replies happens elsewhere. fetch() and sendReplies() may run on different
+// threads at the same time.
+class bot {
+public:
+
+  explicit bot(bot_config config);
+
+  bot(const bot&) = delete;
+  bot& operator=(const bot&) = delete;
+
+  // Verifies the credentials and restores any saved state. Returns false if
+  // the account cannot be used.
+  bool start();
+
+  // Does whatever timeline and follower work is due, appends the posts
+  // that should be considered for a reply, and returns when it next wants
+  // to run.
+  std::chrono::steady_clock::time_point fetch(std::vector<post>& posts);
+
+  void sendReplies(const std::vector<pending_reply>& replies);
+
+  // Writes the state file now, regardless of when it was last written.
+  void flush();
+
+  // Makes requests stop waiting for the rate limit, so that a fetch() or
+  // sendReplies() in progress returns quickly. For shutting down.
+  void stop();
+
+  const std::string& getName() const
+  {
+    return name_;
+  }
+
+private:
+
+  using clock = std::chrono::steady_clock;
+
+  void syncFollowers(clock::time_point now);
+
+  void collectPosts(std::vector<post>& posts);
+
+  void save(clock::time_point now, bool force = false);
+
+  const bot_config config_;
+  std::string name_;
+
+  mastodonpp::Instance instance_;
+  mastodonpp::Connection connection_;
+  std::unique_ptr<transport> liveTransport_;
+  std::unique_ptr<recording_transport> recorder_;
+  request_scheduler scheduler_;
+
+  timeline homeTimeline_;
+  poll_schedule pollSchedule_;
+  std::unique_ptr<timeline_stream> stream_;
+
+  // IDs returned by the most recent backfill, which the stream may deliver
+  // a second time.
+  id_set backfilled_;
+
+  // Written by sendReplies() and read by save(), which run on different
+  // threads.
+  std::mutex repliedMutex_;
+  replied_filter replied_;
+
+  std::unique_ptr<follow_sync> relationships_;
+  clock::time_point nextPoll_;
+  clock::time_point lastReconcile_;
+  clock::time_point lastFollowerSync_;
+  clock::time_point lastSave_;
+  std::time_t reconciledAt_ = 0;
+  bool followersSynced_ = false;
+};
+
+#endif /* end of include guard: BOT_H_A7E25C93 */
@@ -0,0 +1,260 @@
+#ifndef BOUNDED_QUEUE_H_2C9A5F48
+#define BOUNDED_QUEUE_H_2C9A5F48
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// A fixed-capacity multi-producer multi-consumer queue (Dmitry Vyukov's
+// bounded MPMC design). tryPush and tryPop never take a lock. push and pop
+// spin briefly and then sleep on a condition variable while the queue is
+// full or empty, which is what gives the pipeline its backpressure without
+// keeping idle threads awake. Once closed, push fails and pop fails as soon
+// as the queue has been drained.
+template <typename T>
+class bounded_queue {
+public:
+
+  explicit bounded_queue(std::size_t capacity)
+  {
+    std::size_t size = 2;
+    while (size < capacity)
+    {
+      size *= 2;
+    }
+
+    buffer_ = std::make_unique<cell[]>(size);
+    mask_ = size - 1;
+
+    for (std::size_t i = 0; i < size; i++)
+    {
+      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bounded_queue(const bounded_queue&) = delete;
+  bounded_queue& operator=(const bounded_queue&) = delete;
+
+  bool tryPush(T& value)
+  {
+    std::size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+      cell& c = buffer_[pos & mask_];
+      std::size_t sequence = c.sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff =
+        static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+
+      if (diff == 0)
+      {
+        if (enqueuePos_.compare_exchange_weak(
+          pos,
+          pos + 1,
+          std::memory_order_relaxed))
+        {
+          c.data = std::move(value);
+          c.sequence.store(pos + 1, std::memory_order_release);
+
+          return true;
+        }
+      } else if (diff < 0)
+      {
+        // Full.
+        return false;
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool tryPop(T& value)
+  {
+    std::size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+      cell& c = buffer_[pos & mask_];
+      std::size_t sequence = c.sequence.load(std::memory_order_acquire);
+      std::ptrdiff_t diff =
+        static_cast<std::ptrdiff_t>(sequence)
+          - static_cast<std::ptrdiff_t>(pos + 1);
+
+      if (diff == 0)
+      {
+        if (dequeuePos_.compare_exchange_weak(
+          pos,
+          pos + 1,
+          std::memory_order_relaxed))
+        {
+          value = std::move(c.data);
+          c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+
+          return true;
+        }
+      } else if (diff < 0)
+      {
+        // Empty.
+        return false;
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool push(T value)
+  {
+    for (int attempt = 0; attempt < SPIN_ATTEMPTS; attempt++)
+    {
+      if (closed_.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+
+      if (tryPush(value))
+      {
+        wake(popWaiters_, notEmpty_);
+
+        return true;
+      }
+
+      std::this_thread::yield();
+    }
+
+    bool pushed = false;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      pushWaiters_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      notFull_.wait(lock, [&] () {
+        if (closed_.load(std::memory_order_acquire))
+        {
+          return true;
+        }
+
+        pushed = tryPush(value);
+
+        return pushed;
+      });
+
+      pushWaiters_.fetch_sub(1);
+    }
+
+    if (pushed)
+    {
+      wake(popWaiters_, notEmpty_);
+    }
+
+    return pushed;
+  }
+
+  bool pop(T& value)
+  {
+    for (int attempt = 0; attempt < SPIN_ATTEMPTS; attempt++)
+    {
+      if (tryPop(value))
+      {
+        wake(pushWaiters_, notFull_);
+
+        return true;
+      }
+
+      // Check again after seeing the close, in case something was pushed
+      // just before it.
+      if (closed_.load(std::memory_order_acquire))
+      {
+        return tryPop(value);
+      }
+
+      std::this_thread::yield();
+    }
+
+    bool popped = false;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      popWaiters_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      notEmpty_.wait(lock, [&] () {
+        popped = tryPop(value);
+
+        return popped || closed_.load(std::memory_order_acquire);
+      });
+
+      popWaiters_.fetch_sub(1);
+    }
+
+    if (popped)
+    {
+      wake(pushWaiters_, notFull_);
+
+      return true;
+    }
+
+    return tryPop(value);
+  }
+
+  void close()
+  {
+    closed_.store(true, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+  }
+
+  // Only approximate while other threads are pushing or popping.
+  std::size_t size() const
+  {
+    std::size_t enqueued = enqueuePos_.load(std::memory_order_relaxed);
+    std::size_t dequeued = dequeuePos_.load(std::memory_order_relaxed);
+
+    return enqueued >= dequeued ? enqueued - dequeued : 0;
+  }
+
+private:
+
+  struct cell {
+    std::atomic<std::size_t> sequence;
+    T data;
+  };
+
+  // Attempts made before a blocked push or pop parks the thread.
+  static constexpr int SPIN_ATTEMPTS = 16;
+
+  // Called after a push or pop that the other side may be waiting for. The
+  // fence pairs with the one a waiter issues after registering, so either
+  // the waiter sees the change or this sees the waiter. Taking the lock
+  // makes sure the waiter is actually asleep before it is notified.
+  void wake(const std::atomic<int>& waiters, std::condition_variable& cond)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (waiters.load(std::memory_order_relaxed) > 0)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cond.notify_one();
+    }
+  }
+
+  std::unique_ptr<cell[]> buffer_;
+  std::size_t mask_;
+  alignas(64) std::atomic<std::size_t> enqueuePos_ {0};
+  alignas(64) std::atomic<std::size_t> dequeuePos_ {0};
+  std::atomic<bool> closed_ {false};
+
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+  std::atomic<int> pushWaiters_ {0};
+  std::atomic<int> popWaiters_ {0};
+};
+
+#endif /* end of include guard: BOUNDED_QUEUE_H_2C9A5F48 */
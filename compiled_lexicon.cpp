@@ -0,0 +1,388 @@
+#include "compiled_lexicon.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bump this whenever the layout changes; old files are rejected and have to
+// be compiled again.
+const std::uint32_t LEXICON_VERSION = 2;
+const char LEXICON_MAGIC[4] = {'F', 'L', 'E', 'X'};
+
+// Keys per bucket on average, and spare slots, as in the CHD paper. More of
+// either makes building faster and the file bigger.
+const std::size_t KEYS_PER_BUCKET = 4;
+const double SLOT_LOAD = 0.9;
+
+// A bucket that cannot be placed within this many displacements means the
+// forms have colliding hashes.
+const std::uint32_t MAX_DISPLACEMENT = 1 << 24;
+
+const std::uint8_t HAS_ADVERB = 1;
+const std::uint8_t HAS_ADJECTIVE = 2;
+
+//   header
+//   displacements  bucketCount x uint32_t
+//   slots          slotCount x slot
+//   pool           the text of every form, back to back
+struct compiled_lexicon::header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t entryCount;
+  std::uint32_t bucketCount;
+  std::uint32_t slotCount;
+  std::uint32_t poolSize;
+  std::uint32_t reserved;
+  std::uint64_t datafileSize;
+  std::int64_t datafileModified;
+};
+
+// An empty slot has a form length of zero.
+struct compiled_lexicon::slot {
+  std::uint32_t formOffset;
+  std::uint16_t formLength;
+  std::uint8_t partsOfSpeech;
+  std::uint8_t reserved;
+  std::int32_t adverbId;
+  std::int32_t adjectiveId;
+};
+
+namespace {
+
+  std::uint64_t hashForm(std::string_view form)
+  {
+    // FNV-1a.
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (unsigned char ch : form)
+    {
+      hash = (hash ^ ch) * 0x100000001B3ull;
+    }
+
+    return hash;
+  }
+
+  // splitmix64's finalizer, which spreads FNV's weak low bits.
+  std::uint64_t mix(std::uint64_t value)
+  {
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+    return value ^ (value >> 31);
+  }
+
+  std::uint32_t bucketOf(std::uint64_t hash, std::uint32_t bucketCount)
+  {
+    return mix(hash) % bucketCount;
+  }
+
+  std::uint32_t slotOf(
+    std::uint64_t hash,
+    std::uint32_t displacement,
+    std::uint32_t slotCount)
+  {
+    return mix(hash ^ ((displacement + 1) * 0x9E3779B97F4A7C15ull))
+      % slotCount;
+  }
+
+  // Identifies a version of the verbly datafile without reading all of it.
+  // Nanoseconds, as a replaced file can easily share a second with the old
+  // one.
+  void stampDatafile(
+    const std::string& datafile,
+    std::uint64_t& size,
+    std::int64_t& modified)
+  {
+    struct stat info;
+    if (::stat(datafile.c_str(), &info) != 0)
+    {
+      throw std::runtime_error(
+        "Could not stat " + datafile + ": " + std::strerror(errno));
+    }
+
+    size = info.st_size;
+    modified = std::int64_t(info.st_mtim.tv_sec) * 1000000000
+      + info.st_mtim.tv_nsec;
+  }
+
+  template <typename T>
+  void writeArray(std::ofstream& out, const std::vector<T>& values)
+  {
+    out.write(
+      reinterpret_cast<const char*>(values.data()),
+      values.size() * sizeof(T));
+  }
+
+}
+
+compiled_lexicon::compiled_lexicon(
+  const std::string& path,
+  const std::string& datafile)
+{
+  std::uint64_t datafileSize;
+  std::int64_t datafileModified;
+  stampDatafile(datafile, datafileSize, datafileModified);
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    throw std::runtime_error(
+      "Could not open " + path + ": " + std::strerror(errno));
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0)
+  {
+    int error = errno;
+    ::close(fd);
+
+    throw std::runtime_error(
+      "Could not stat " + path + ": " + std::strerror(error));
+  }
+
+  mappingSize_ = info.st_size;
+  if (mappingSize_ < sizeof(header))
+  {
+    ::close(fd);
+
+    throw std::runtime_error("Not a compiled lexicon: " + path);
+  }
+
+  void* mapping = ::mmap(nullptr, mappingSize_, PROT_READ, MAP_SHARED, fd, 0);
+  int error = errno;
+  ::close(fd);
+
+  if (mapping == MAP_FAILED)
+  {
+    throw std::runtime_error(
+      "Could not map " + path + ": " + std::strerror(error));
+  }
+
+  mapping_ = mapping;
+
+  const char* bytes = static_cast<const char*>(mapping_);
+  const header* head = reinterpret_cast<const header*>(bytes);
+
+  std::size_t expectedSize = sizeof(header)
+    + std::size_t(head->bucketCount) * sizeof(std::uint32_t)
+    + std::size_t(head->slotCount) * sizeof(slot)
+    + head->poolSize;
+
+  if (std::memcmp(head->magic, LEXICON_MAGIC, sizeof(LEXICON_MAGIC)) != 0
+    || head->version != LEXICON_VERSION
+    || head->bucketCount == 0
+    || head->slotCount == 0
+    || expectedSize != mappingSize_)
+  {
+    ::munmap(mapping, mappingSize_);
+
+    throw std::runtime_error(
+      "Not a compiled lexicon, or from another version: " + path);
+  }
+
+  if (head->datafileSize != datafileSize
+    || head->datafileModified != datafileModified)
+  {
+    ::munmap(mapping, mappingSize_);
+
+    // The word IDs would silently point at the wrong words.
+    throw std::runtime_error(
+      path + " was compiled from a different " + datafile
+        + "; run father_lexicon_compile again");
+  }
+
+  entryCount_ = head->entryCount;
+  bucketCount_ = head->bucketCount;
+  slotCount_ = head->slotCount;
+  poolSize_ = head->poolSize;
+
+  bytes += sizeof(header);
+  displacements_ = reinterpret_cast<const std::uint32_t*>(bytes);
+
+  bytes += std::size_t(bucketCount_) * sizeof(std::uint32_t);
+  slots_ = reinterpret_cast<const slot*>(bytes);
+
+  bytes += std::size_t(slotCount_) * sizeof(slot);
+  pool_ = bytes;
+}
+
+compiled_lexicon::~compiled_lexicon()
+{
+  if (mapping_)
+  {
+    ::munmap(const_cast<void*>(mapping_), mappingSize_);
+  }
+}
+
+int compiled_lexicon::find(
+  std::string_view form,
+  verbly::part_of_speech partOfSpeech) const
+{
+  std::uint64_t hash = hashForm(form);
+  std::uint32_t displacement = displacements_[bucketOf(hash, bucketCount_)];
+  const slot& candidate = slots_[slotOf(hash, displacement, slotCount_)];
+
+  // Every form hashes to some slot, so the text has to be checked.
+  if (candidate.formLength != form.size()
+    || std::size_t(candidate.formOffset) + candidate.formLength > poolSize_
+    || std::memcmp(pool_ + candidate.formOffset, form.data(), form.size()) != 0)
+  {
+    return -1;
+  }
+
+  switch (partOfSpeech)
+  {
+    case verbly::part_of_speech::adverb:
+    {
+      return (candidate.partsOfSpeech & HAS_ADVERB) ? candidate.adverbId : -1;
+    }
+
+    case verbly::part_of_speech::adjective:
+    {
+      return (candidate.partsOfSpeech & HAS_ADJECTIVE)
+        ? candidate.adjectiveId
+        : -1;
+    }
+
+    default:
+    {
+      return -1;
+    }
+  }
+}
+
+void compiled_lexicon::write(
+  const std::string& path,
+  const std::string& datafile,
+  const std::vector<entry>& entries)
+{
+  std::uint32_t slotCount =
+    static_cast<std::uint32_t>(entries.size() / SLOT_LOAD) + 1;
+  std::uint32_t bucketCount =
+    static_cast<std::uint32_t>(entries.size() / KEYS_PER_BUCKET) + 1;
+
+  std::vector<std::uint64_t> hashes;
+  std::vector<std::vector<std::uint32_t>> buckets(bucketCount);
+
+  for (std::uint32_t i = 0; i < entries.size(); i++)
+  {
+    if (entries[i].form.empty() || entries[i].form.size() > UINT16_MAX)
+    {
+      throw std::invalid_argument("Form cannot be stored: " + entries[i].form);
+    }
+
+    hashes.push_back(hashForm(entries[i].form));
+    buckets[bucketOf(hashes.back(), bucketCount)].push_back(i);
+  }
+
+  // Biggest buckets first, while most slots are still free.
+  std::vector<std::uint32_t> order(bucketCount);
+  for (std::uint32_t b = 0; b < bucketCount; b++)
+  {
+    order[b] = b;
+  }
+
+  std::stable_sort(
+    std::begin(order),
+    std::end(order),
+    [&] (std::uint32_t left, std::uint32_t right) {
+      return buckets[left].size() > buckets[right].size();
+    });
+
+  std::vector<std::uint32_t> displacements(bucketCount, 0);
+  std::vector<slot> slots(slotCount, slot {0, 0, 0, 0, -1, -1});
+  std::vector<bool> taken(slotCount, false);
+  std::vector<std::uint32_t> placed;
+
+  for (std::uint32_t b : order)
+  {
+    const std::vector<std::uint32_t>& keys = buckets[b];
+    if (keys.empty())
+    {
+      break;
+    }
+
+    std::uint32_t displacement = 0;
+    for (;; displacement++)
+    {
+      if (displacement == MAX_DISPLACEMENT)
+      {
+        throw std::runtime_error(
+          "Could not build a perfect hash; are the forms unique?");
+      }
+
+      placed.clear();
+      for (std::uint32_t key : keys)
+      {
+        std::uint32_t s = slotOf(hashes[key], displacement, slotCount);
+        if (taken[s]
+          || std::find(std::begin(placed), std::end(placed), s)
+            != std::end(placed))
+        {
+          break;
+        }
+
+        placed.push_back(s);
+      }
+
+      if (placed.size() == keys.size())
+      {
+        break;
+      }
+    }
+
+    displacements[b] = displacement;
+    for (std::size_t k = 0; k < keys.size(); k++)
+    {
+      taken[placed[k]] = true;
+      slots[placed[k]].formOffset = keys[k];
+    }
+  }
+
+  // formOffset temporarily holds the entry index; lay out the pool in slot
+  // order so that neighbouring slots have neighbouring text.
+  std::string pool;
+  for (std::uint32_t s = 0; s < slotCount; s++)
+  {
+    if (!taken[s])
+    {
+      continue;
+    }
+
+    const entry& e = entries[slots[s].formOffset];
+
+    slot& out = slots[s];
+    out.formOffset = pool.size();
+    out.formLength = e.form.size();
+    out.partsOfSpeech = (e.adverbId >= 0 ? HAS_ADVERB : 0)
+      | (e.adjectiveId >= 0 ? HAS_ADJECTIVE : 0);
+    out.adverbId = e.adverbId;
+    out.adjectiveId = e.adjectiveId;
+
+    pool += e.form;
+  }
+
+  header head {};
+  std::memcpy(head.magic, LEXICON_MAGIC, sizeof(LEXICON_MAGIC));
+  head.version = LEXICON_VERSION;
+  head.entryCount = entries.size();
+  head.bucketCount = bucketCount;
+  head.slotCount = slotCount;
+  head.poolSize = pool.size();
+  stampDatafile(datafile, head.datafileSize, head.datafileModified);
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+  writeArray(out, displacements);
+  writeArray(out, slots);
+  out.write(pool.data(), pool.size());
+
+  if (!out.flush())
+  {
+    throw std::runtime_error("Could not write " + path);
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef COMPILED_LEXICON_H_71B3E9D0
+#define COMPILED_LEXICON_H_71B3E9D0
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <verbly.h>
+
+// The part of the verbly database father actually needs (which word, if
+// any, a form is as an adverb and as an adjective) in a file that can be
+// mapped straight into memory. Forms are found with a minimal-probe
+// perfect hash (hash and displace): one hash picks a bucket, the bucket's
+// stored displacement picks the slot, and a single string comparison
+// confirms it. The mapping is read-only and shared, so startup does no
+// work and every process on the machine uses the same page cache.
+//
+// The file is written in native byte order by father_lexicon_compile and
+// is meant to be used on the machine (or architecture) that built it. It
+// stores verbly word IDs, which are only meaningful for the datafile they
+// came from, so it also records that datafile's size and modification time
+// and refuses to load against any other.
+class compiled_lexicon {
+public:
+
+  struct entry {
+    std::string form;
+    int adverbId = -1;
+    int adjectiveId = -1;
+  };
+
+  // Throws if the file cannot be mapped, is not a compiled lexicon, or was
+  // not compiled from this verbly datafile.
+  compiled_lexicon(const std::string& path, const std::string& datafile);
+
+  ~compiled_lexicon();
+
+  compiled_lexicon(const compiled_lexicon&) = delete;
+  compiled_lexicon& operator=(const compiled_lexicon&) = delete;
+
+  // The verbly word ID for the form in that part of speech, or -1.
+  int find(std::string_view form, verbly::part_of_speech partOfSpeech) const;
+
+  std::size_t getSize() const
+  {
+    return entryCount_;
+  }
+
+  // Builds the hash and writes the file. Forms must be unique, and the word
+  // IDs must come from the given verbly datafile.
+  static void write(
+    const std::string& path,
+    const std::string& datafile,
+    const std::vector<entry>& entries);
+
+private:
+
+  struct header;
+  struct slot;
+
+  const void* mapping_ = nullptr;
+  std::size_t mappingSize_ = 0;
+
+  std::size_t entryCount_ = 0;
+  std::uint32_t bucketCount_ = 0;
+  std::uint32_t slotCount_ = 0;
+  std::uint32_t poolSize_ = 0;
+  const std::uint32_t* displacements_ = nullptr;
+  const slot* slots_ = nullptr;
+  const char* pool_ = nullptr;
+};
+
+#endif /* end of include guard: COMPILED_LEXICON_H_71B3E9D0 */
@@ -1,74 +1,78 @@
-#include <mastodonpp/mastodonpp.hpp>
 #include <random>
 #include <yaml-cpp/yaml.h>
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <string>
-#include <algorithm>
-#include <set>
-#include <list>
-#include <iterator>
-#include <verbly.h>
-#include <hkutil/string.h>
-#include <json.hpp>
-#include "timeline.h"
-
-// Sync followers every 4 hours.
-const int CHECK_FOLLOWERS_EVERY = 4 * 60 / 5;
-
-verbly::word findWordOfType(
-  verbly::database& database,
-  std::string form,
-  verbly::part_of_speech partOfSpeech)
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <csignal>
+#include "bot.h"
+#include "metrics.h"
+#include "pipeline.h"
+
+// Number of (form, part of speech) lookups remembered across posts.
+const int DEFAULT_LEXICON_CACHE_SIZE = 4096;
+
+// Worker threads that analyze posts, each with its own verbly connection.
+const int DEFAULT_ANALYZER_THREADS = 2;
+
+// Posts or replies that may wait between two stages before the stage
+// feeding them has to wait.
+const int DEFAULT_QUEUE_CAPACITY = 256;
+
+// How often to log the metrics when they are not served over HTTP.
+const std::chrono::minutes METRICS_LOG_EVERY {5};
+
+std::atomic<bool> shouldStop {false};
+
+void requestStop(int)
 {
-  std::vector<verbly::word> isThing = database.words(
-    (verbly::notion::partOfSpeech == partOfSpeech)
-    && (verbly::form::text == form)).all();
+  shouldStop = true;
+}
+
+bot_config readBotConfig(const YAML::Node& node)
+{
+  bot_config result;
+  result.instance = node["mastodon_instance"].as<std::string>();
+  result.token = node["mastodon_token"].as<std::string>();
 
-  if (isThing.empty())
+  if (node["state_file"])
   {
-    return {};
-  } else {
-    return isThing.front();
+    result.statePath = node["state_file"].as<std::string>();
   }
-}
 
-std::set<std::string> getPaginatedList(
-  mastodonpp::Connection& connection,
-  mastodonpp::API::endpoint_type endpoint,
-  std::string account_id)
-{
-  std::set<std::string> result;
+  if (node["streaming"])
+  {
+    result.streaming = node["streaming"].as<bool>();
+  }
 
-  mastodonpp::parametermap parameters;
-  for (;;)
+  if (node["streaming_url"])
   {
-    parameters["id"] = account_id;
+    result.streamingUrl = node["streaming_url"].as<std::string>();
+  }
 
-    auto answer = connection.get(endpoint, parameters);
-    if (!answer)
-    {
-      if (answer.curl_error_code == 0)
-      {
-        std::cout << "HTTP status: " << answer.http_status << std::endl;
-      }
-      else
-      {
-        std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
-             << ": " << answer.error_message << std::endl;
-      }
-      return {};
-    }
+  if (node["max_requests_in_flight"])
+  {
+    result.maxInFlight = node["max_requests_in_flight"].as<std::size_t>();
+  }
 
-    parameters = answer.next();
-    if (parameters.empty()) break;
+  if (node["dedup_capacity"])
+  {
+    result.dedupCapacity = node["dedup_capacity"].as<std::size_t>();
+  }
 
-    nlohmann::json body = nlohmann::json::parse(answer.body);
-    for (const auto& item : body)
-    {
-      result.insert(item["id"].get<std::string>());
-    }
+  if (node["dedup_false_positive_rate"])
+  {
+    result.dedupFalsePositiveRate =
+      node["dedup_false_positive_rate"].as<double>();
+  }
+
+  // Optionally keep every response around for father_bench to replay.
+  if (node["record_file"])
+  {
+    result.recordFile = node["record_file"].as<std::string>();
   }
 
   return result;
@@ -76,9 +80,6 @@ std::set<std::string> getPaginatedList(
 
 int main(int argc, char** argv)
 {
-  std::random_device randomDevice;
-  std::mt19937 rng{randomDevice()};
-
   if (argc != 2)
   {
     std::cout << "usage: father [configfile]" << std::endl;
@@ -88,257 +89,135 @@ int main(int argc, char** argv)
   std::string configfile(argv[1]);
   YAML::Node config = YAML::LoadFile(configfile);
 
-  verbly::database database(config["verbly_datafile"].as<std::string>());
-
-  mastodonpp::Instance instance{
-    config["mastodon_instance"].as<std::string>(),
-    config["mastodon_token"].as<std::string>()};
-  mastodonpp::Connection connection{instance};
+  std::random_device randomDevice;
+  unsigned int seed = randomDevice();
+  if (config["random_seed"])
+  {
+    seed = config["random_seed"].as<unsigned int>();
+  }
 
-  nlohmann::json account_details;
+  int lexiconCacheSize = DEFAULT_LEXICON_CACHE_SIZE;
+  if (config["lexicon_cache_size"])
   {
-    const mastodonpp::parametermap parameters {};
-    auto answer = connection.get(mastodonpp::API::v1::accounts_verify_credentials, parameters);
-    if (!answer)
-    {
-      if (answer.curl_error_code == 0)
-      {
-        std::cout << "HTTP status: " << answer.http_status << std::endl;
-      }
-      else
-      {
-        std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
-             << ": " << answer.error_message << std::endl;
-      }
-      return 1;
-    }
-    std::cout << answer.body << std::endl;
-    account_details = nlohmann::json::parse(answer.body);
+    lexiconCacheSize = config["lexicon_cache_size"].as<int>();
   }
 
-  timeline home_timeline(mastodonpp::API::v1::timelines_home);
-  home_timeline.poll(connection); // just ignore the results
+  int analyzerThreads = DEFAULT_ANALYZER_THREADS;
+  if (config["analyzer_threads"])
+  {
+    analyzerThreads = config["analyzer_threads"].as<int>();
+  }
 
-  auto startedTime = std::chrono::system_clock::now();
+  int queueCapacity = DEFAULT_QUEUE_CAPACITY;
+  if (config["queue_capacity"])
+  {
+    queueCapacity = config["queue_capacity"].as<int>();
+  }
 
-  std::set<std::string> friends;
-  int followerTimeout = 0;
+  // Made by father_lexicon_compile; without it words are looked up in the
+  // verbly database.
+  std::string lexiconFile;
+  if (config["lexicon_file"])
+  {
+    lexiconFile = config["lexicon_file"].as<std::string>();
+  }
 
-  for (;;)
+  // Phrases after which the next words are taken as what the poster is.
+  // Left empty, the matcher's defaults are used.
+  std::vector<std::string> triggers;
+  if (config["triggers"])
   {
-    if (followerTimeout == 0)
-    {
-      // Sync friends with followers.
-      try
-      {
-        friends = getPaginatedList(
-          connection,
-          mastodonpp::API::v1::accounts_id_following,
-          account_details["id"].get<std::string>());
-
-        std::set<std::string> followers = getPaginatedList(
-          connection,
-          mastodonpp::API::v1::accounts_id_followers,
-          account_details["id"].get<std::string>());
-
-        std::list<std::string> oldFriends;
-        std::set_difference(
-          std::begin(friends),
-          std::end(friends),
-          std::begin(followers),
-          std::end(followers),
-          std::back_inserter(oldFriends));
-
-        std::set<std::string> newFollowers;
-        std::set_difference(
-          std::begin(followers),
-          std::end(followers),
-          std::begin(friends),
-          std::end(friends),
-          std::inserter(newFollowers, std::begin(newFollowers)));
-
-        for (const std::string& f : oldFriends)
-        {
-          const mastodonpp::parametermap parameters {{"id", f}};
-          auto answer = connection.post(mastodonpp::API::v1::accounts_id_unfollow, parameters);
-          if (!answer)
-          {
-            if (answer.curl_error_code == 0)
-            {
-              std::cout << "HTTP status: " << answer.http_status << std::endl;
-            }
-            else
-            {
-              std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
-                   << ": " << answer.error_message << std::endl;
-            }
-          }
-        }
+    triggers = config["triggers"].as<std::vector<std::string>>();
+  }
 
-        for (const std::string& f : newFollowers)
-        {
-          const mastodonpp::parametermap parameters {{"id", f}, {"reblogs", "false"}};
-          auto answer = connection.post(mastodonpp::API::v1::accounts_id_follow, parameters);
-          if (!answer)
-          {
-            if (answer.curl_error_code == 0)
-            {
-              std::cout << "HTTP status: " << answer.http_status << std::endl;
-            }
-            else
-            {
-              std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
-                   << ": " << answer.error_message << std::endl;
-            }
-          }
-        }
-      } catch (const std::exception& error)
-      {
-        std::cout << "Error while syncing followers: " << error.what()
-          << std::endl;
-      }
+  std::unique_ptr<metrics::server> metricsServer;
+  if (config["metrics_port"])
+  {
+    metricsServer = std::make_unique<metrics::server>(
+      config["metrics_port"].as<int>());
+  }
 
-      followerTimeout = CHECK_FOLLOWERS_EVERY;
+  // Either a list of accounts, or a single account at the top level.
+  std::vector<bot_config> accounts;
+  if (config["accounts"])
+  {
+    for (const YAML::Node& node : config["accounts"])
+    {
+      accounts.push_back(readBotConfig(node));
     }
+  } else {
+    accounts.push_back(readBotConfig(config));
+  }
 
-    followerTimeout--;
+  std::vector<std::unique_ptr<bot>> bots;
+  for (bot_config& account : accounts)
+  {
+    auto b = std::make_unique<bot>(std::move(account));
 
+    bool started = false;
     try
     {
-      // Poll the timeline.
-      std::list<nlohmann::json> posts = home_timeline.poll(connection);
+      started = b->start();
+    } catch (const std::exception& error)
+    {
+      std::cout << error.what() << std::endl;
+    }
 
-      for (const nlohmann::json& post : posts)
+    if (started)
+    {
+      bots.push_back(std::move(b));
+    } else {
+      std::cout << "Could not start bot for " << b->getName() << std::endl;
+    }
+  }
+
+  if (bots.empty())
+  {
+    return 1;
+  }
+
+  pipeline stages(
+    bots,
+    config["verbly_datafile"].as<std::string>(),
+    lexiconFile,
+    triggers,
+    analyzerThreads,
+    lexiconCacheSize,
+    queueCapacity,
+    seed);
+
+  std::signal(SIGTERM, requestStop);
+  std::signal(SIGINT, requestStop);
+
+  std::thread metricsLogger;
+  if (!metricsServer)
+  {
+    metricsLogger = std::thread([] {
+      auto lastMetricsLog = std::chrono::steady_clock::now();
+
+      while (!shouldStop)
       {
-        if (
-          // Only monitor people you are following
-          friends.count(post["account"]["id"].get<std::string>())
-          // Ignore retweets
-          && post["reblog"].is_null())
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        if (std::chrono::steady_clock::now() - lastMetricsLog
+          >= METRICS_LOG_EVERY)
         {
-          std::string post_content = post["content"].get<std::string>();
-          std::string::size_type pos;
-          while ((pos = post_content.find("<")) != std::string::npos)
-          {
-            std::string prefix = post_content.substr(0, pos);
-            std::string rest = post_content.substr(pos);
-            std::string::size_type right_pos = rest.find(">");
-            if (right_pos == std::string::npos) {
-              post_content = prefix;
-            } else {
-              post_content = prefix + rest.substr(right_pos);
-            }
-          }
-
-          std::vector<std::string> tokens =
-            hatkirby::split<std::vector<std::string>>(post_content, " ");
-
-          std::vector<std::string> canonical;
-          for (std::string token : tokens)
-          {
-            std::string canonStr;
-            for (char ch : token)
-            {
-              if (std::isalpha(ch))
-              {
-                canonStr += std::tolower(ch);
-              }
-            }
-
-            canonical.push_back(canonStr);
-          }
-
-          std::vector<std::string>::iterator imIt =
-            std::find(std::begin(canonical), std::end(canonical), "im");
-
-          if (imIt != std::end(canonical))
-          {
-            imIt++;
-
-            if (imIt != std::end(canonical))
-            {
-              verbly::token name;
-
-              verbly::word firstAdverb = findWordOfType(
-                database,
-                *imIt,
-                verbly::part_of_speech::adverb);
-
-              if (firstAdverb.isValid())
-              {
-                std::vector<std::string>::iterator adjIt = imIt;
-                adjIt++;
-
-                if (adjIt != std::end(canonical))
-                {
-                  verbly::word secondAdjective = findWordOfType(
-                    database,
-                    *adjIt,
-                    verbly::part_of_speech::adjective);
-
-                  if (secondAdjective.isValid())
-                  {
-                    name << firstAdverb;
-                    name << secondAdjective;
-                  }
-                }
-              }
-
-              if (name.isEmpty())
-              {
-                verbly::word firstAdjective = findWordOfType(
-                  database,
-                  *imIt,
-                  verbly::part_of_speech::adjective);
-
-                if (firstAdjective.isValid())
-                {
-                  name = firstAdjective;
-                }
-              }
-
-              if ((!name.isEmpty())
-                && (std::bernoulli_distribution(1.0/10.0)(rng)))
-              {
-                verbly::token action = {
-                  "Hi",
-                  verbly::token::punctuation(",",
-                    verbly::token::capitalize(
-                      verbly::token::casing::title_case,
-                      name)),
-                  "I'm Dad."};
-
-                std::string result = "@" + post["account"]["acct"].get<std::string>() + " " + action.compile();
-
-                mastodonpp::parametermap parameters{
-                  {"status", result},
-                  {"in_reply_to_id", post["id"].get<std::string>()}};
-
-                auto answer{connection.post(mastodonpp::API::v1::statuses, parameters)};
-                if (!answer)
-                {
-                  if (answer.curl_error_code == 0)
-                  {
-                    std::cout << "HTTP status: " << answer.http_status << std::endl;
-                  }
-                  else
-                  {
-                    std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
-                         << ": " << answer.error_message << std::endl;
-                  }
-                }
-              }
-            }
-          }
+          std::cout << metrics::renderLogLine() << std::endl;
+
+          lastMetricsLog = std::chrono::steady_clock::now();
         }
       }
-    } catch (const std::exception&)
-    {
-      // Wait out the rate limit (10 minutes here and 5 below = 15).
-      std::this_thread::sleep_for(std::chrono::minutes(10));
-    }
+    });
+  }
+
+  stages.run(shouldStop);
 
-    // We can poll the timeline at most once every five minutes.
-    std::this_thread::sleep_for(std::chrono::minutes(5));
+  if (metricsLogger.joinable())
+  {
+    metricsLogger.join();
   }
+
+  std::cout << metrics::renderLogLine() << std::endl;
+
+  return 0;
 }
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <verbly.h>
+#include "compiled_lexicon.h"
+
+// Extracts every adverb and adjective from a verbly datafile into a
+// compiled lexicon for father's lexicon_file setting.
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+  {
+    std::cout << "usage: father_lexicon_compile [verbly datafile] [output]"
+      << std::endl;
+    return -1;
+  }
+
+  verbly::database database(argv[1]);
+
+  // A negative limit lifts verbly's default of a single row.
+  std::vector<verbly::word> found = database.words(
+    (verbly::notion::partOfSpeech == verbly::part_of_speech::adverb)
+      || (verbly::notion::partOfSpeech == verbly::part_of_speech::adjective),
+    {},
+    -1).all();
+
+  // Keyed by base form, like the lexicon's database lookups. The first
+  // word seen for a form and part of speech wins, as it does there.
+  std::map<std::string, compiled_lexicon::entry> byForm;
+  for (const verbly::word& w : found)
+  {
+    const std::string& text = w.getBaseForm().getText();
+
+    compiled_lexicon::entry& e = byForm[text];
+    e.form = text;
+
+    if (w.getNotion().getPartOfSpeech() == verbly::part_of_speech::adverb)
+    {
+      if (e.adverbId < 0)
+      {
+        e.adverbId = w.getId();
+      }
+    } else if (e.adjectiveId < 0)
+    {
+      e.adjectiveId = w.getId();
+    }
+  }
+
+  std::vector<compiled_lexicon::entry> entries;
+  for (auto& [form, e] : byForm)
+  {
+    entries.push_back(std::move(e));
+  }
+
+  try
+  {
+    compiled_lexicon::write(argv[2], argv[1], entries);
+  } catch (const std::exception& error)
+  {
+    std::cout << error.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote " << entries.size() << " forms (" << found.size()
+    << " words) to " << argv[2] << std::endl;
+}
@@ -0,0 +1,319 @@
+#include "follow_sync.h"
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <variant>
+#include <vector>
+#include <json.hpp>
+#include "metrics.h"
+
+// Pages of the following and followers lists fetched per reconcile() call.
+// At 80 accounts a page, an account with 50,000 followers takes a few
+// hundred calls.
+const int RECONCILE_PAGES_PER_STEP = 5;
+
+namespace {
+
+  void logFailure(const mastodonpp::answer_type& answer)
+  {
+    if (answer.curl_error_code == 0)
+    {
+      std::cout << "HTTP status: " << answer.http_status << std::endl;
+    }
+    else
+    {
+      std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
+           << ": " << answer.error_message << std::endl;
+    }
+  }
+
+  // The parametermap returned by answer_type::next() points into the
+  // answer's headers, so it has to be copied before the answer goes away.
+  std::map<std::string, std::string> ownParameters(
+    const mastodonpp::parametermap& parameters)
+  {
+    std::map<std::string, std::string> result;
+    for (const auto& [key, value] : parameters)
+    {
+      if (std::holds_alternative<std::string_view>(value))
+      {
+        result[std::string(key)] = std::get<std::string_view>(value);
+      }
+    }
+
+    return result;
+  }
+
+  // Mastodon IDs come as strings in JSON.
+  std::uint64_t getId(const nlohmann::json& value)
+  {
+    std::uint64_t id;
+    if (!parseId(value.get<std::string>(), id))
+    {
+      throw std::runtime_error("Unexpected ID: " + value.dump());
+    }
+
+    return id;
+  }
+
+}
+
+follow_sync::follow_sync(std::string accountId) : accountId_(std::move(accountId))
+{
+}
+
+bool follow_sync::reconcile(request_scheduler& scheduler)
+{
+  if (!reconciling_)
+  {
+    // Remember where the notifications are before fetching the lists, so
+    // that anyone who follows in the meantime is picked up by update().
+    if (!hasCursor_)
+    {
+      const mastodonpp::parametermap parameters {{"limit", "1"}};
+      auto answer =
+        scheduler.get(mastodonpp::API::v1::notifications, parameters);
+      if (!answer)
+      {
+        logFailure(answer);
+
+        throw std::runtime_error("Could not fetch notifications");
+      }
+
+      nlohmann::json body = nlohmann::json::parse(answer.body);
+      if (!body.empty())
+      {
+        notificationCursor_ = getId(body.front()["id"]);
+      }
+
+      hasCursor_ = true;
+    }
+
+    following_ = account_list();
+    followers_ = account_list();
+    reconciling_ = true;
+  }
+
+  for (int i = 0; i < RECONCILE_PAGES_PER_STEP; i++)
+  {
+    if (!following_.complete)
+    {
+      fetchPage(
+        scheduler,
+        mastodonpp::API::v1::accounts_id_following,
+        following_);
+    } else if (!followers_.complete)
+    {
+      fetchPage(
+        scheduler,
+        mastodonpp::API::v1::accounts_id_followers,
+        followers_);
+    } else {
+      break;
+    }
+  }
+
+  if (!following_.complete || !followers_.complete)
+  {
+    return false;
+  }
+
+  id_set followers(std::move(followers_.ids));
+
+  friends_ = id_set(std::move(following_.ids));
+  pendingUnfollows_ = friends_.difference(followers);
+  pendingFollows_ = followers.difference(friends_);
+
+  following_ = account_list();
+  followers_ = account_list();
+  reconciling_ = false;
+
+  return true;
+}
+
+void follow_sync::fetchPage(
+  request_scheduler& scheduler,
+  mastodonpp::API::endpoint_type endpoint,
+  account_list& list)
+{
+  static metrics::counter& pages = metrics::getCounter(
+    "father_account_list_pages_total",
+    "Following and followers pages fetched");
+
+  mastodonpp::parametermap parameters;
+  for (const auto& [key, value] : list.cursor)
+  {
+    parameters[key] = value;
+  }
+
+  parameters["id"] = accountId_;
+  parameters["limit"] = "80";
+
+  auto answer = scheduler.get(endpoint, parameters);
+  if (!answer)
+  {
+    logFailure(answer);
+
+    throw std::runtime_error("Could not fetch account list");
+  }
+
+  pages.add();
+
+  nlohmann::json body = nlohmann::json::parse(answer.body);
+  for (const auto& item : body)
+  {
+    list.ids.push_back(getId(item["id"]));
+  }
+
+  list.cursor = ownParameters(answer.next());
+  list.complete = list.cursor.empty() || body.empty();
+}
+
+void follow_sync::update(request_scheduler& scheduler)
+{
+  if (!hasCursor_)
+  {
+    // Without a cursor there is no way to tell which notifications are new.
+    return;
+  }
+
+  // min_id pages forward from the cursor, so nothing is skipped even if
+  // more follows arrived than fit on one page.
+  for (;;)
+  {
+    // Sent even when it is zero (there were no notifications at all), as
+    // without min_id the newest page comes back and older ones are lost.
+    std::string cursor = std::to_string(notificationCursor_);
+
+    mastodonpp::parametermap parameters {
+      {"types", std::vector<std::string_view>{"follow"}},
+      {"min_id", cursor},
+      {"limit", "80"}};
+
+    auto answer = scheduler.get(mastodonpp::API::v1::notifications, parameters);
+    if (!answer)
+    {
+      logFailure(answer);
+
+      return;
+    }
+
+    nlohmann::json body = nlohmann::json::parse(answer.body);
+    if (body.empty())
+    {
+      break;
+    }
+
+    for (const auto& notification : body)
+    {
+      if (notification["type"].get<std::string>() == "follow")
+      {
+        std::uint64_t id = getId(notification["account"]["id"]);
+        if (!friends_.contains(id))
+        {
+          pendingFollows_.insert(id);
+        }
+      }
+    }
+
+    notificationCursor_ = getId(body.front()["id"]);
+  }
+}
+
+void follow_sync::store(bot_state& state) const
+{
+  state.friends = friends_;
+  state.pendingFollows = pendingFollows_;
+  state.pendingUnfollows = pendingUnfollows_;
+  state.hasNotificationCursor = hasCursor_;
+  state.notificationCursor = notificationCursor_;
+}
+
+void follow_sync::restore(const bot_state& state)
+{
+  friends_ = state.friends;
+  pendingFollows_ = state.pendingFollows;
+  pendingUnfollows_ = state.pendingUnfollows;
+  hasCursor_ = state.hasNotificationCursor;
+  notificationCursor_ = state.notificationCursor;
+}
+
+void follow_sync::drain(request_scheduler& scheduler)
+{
+  struct in_flight {
+    std::uint64_t id;
+    bool follow;
+    std::future<mastodonpp::answer_type> answer;
+  };
+
+  // Send everything the budget allows at once and only then wait, so the
+  // requests overlap when the transport supports it.
+  std::vector<in_flight> requests;
+
+  while (!pendingUnfollows_.empty()
+    && scheduler.hasBudget(
+      mastodonpp::API::v1::accounts_id_unfollow,
+      request_priority::bulk))
+  {
+    std::uint64_t id = *std::begin(pendingUnfollows_);
+    pendingUnfollows_.erase(id);
+
+    std::string idText = std::to_string(id);
+    const mastodonpp::parametermap parameters {{"id", idText}};
+    auto answer = scheduler.postAsync(
+      mastodonpp::API::v1::accounts_id_unfollow,
+      parameters,
+      request_priority::bulk);
+
+    requests.push_back({id, false, std::move(answer)});
+  }
+
+  while (!pendingFollows_.empty()
+    && scheduler.hasBudget(
+      mastodonpp::API::v1::accounts_id_follow,
+      request_priority::bulk))
+  {
+    std::uint64_t id = *std::begin(pendingFollows_);
+    pendingFollows_.erase(id);
+
+    std::string idText = std::to_string(id);
+    const mastodonpp::parametermap parameters {
+      {"id", idText},
+      {"reblogs", "false"}};
+    auto answer = scheduler.postAsync(
+      mastodonpp::API::v1::accounts_id_follow,
+      parameters,
+      request_priority::bulk);
+
+    requests.push_back({id, true, std::move(answer)});
+  }
+
+  for (in_flight& request : requests)
+  {
+    mastodonpp::answer_type answer = request.answer.get();
+    if (!answer)
+    {
+      logFailure(answer);
+
+      if (answer.http_status == 429 || answer.http_status >= 500
+        || answer.curl_error_code != 0)
+      {
+        // Try again on the next drain.
+        if (request.follow)
+        {
+          pendingFollows_.insert(request.id);
+        } else {
+          pendingUnfollows_.insert(request.id);
+        }
+      }
+    } else if (request.follow)
+    {
+      friends_.insert(request.id);
+    } else {
+      friends_.erase(request.id);
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef FOLLOW_SYNC_H_92D6F3A8
+#define FOLLOW_SYNC_H_92D6F3A8
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "id_set.h"
+#include "request_scheduler.h"
+#include "state_file.h"
+
+// Keeps the bot following exactly the accounts that follow it. New
+// followers are picked up incrementally from follow notifications; since
+// Mastodon does not notify about unfollows, a full reconciliation of both
+// lists is still needed every now and then; it is fetched a few pages at a
+// time so that a large account does not hold up the others. Follows and
+// unfollows are queued and sent by drain() as the rate limit allows.
+class follow_sync {
+public:
+
+  explicit follow_sync(std::string accountId);
+
+  // Fetches the next few pages of the following and followers lists,
+  // starting a new reconciliation if none is in progress. Once both lists
+  // are complete, queues follows and unfollows until they match and returns
+  // true. Throws if a page could not be fetched, leaving the friend set
+  // untouched; the next call tries that page again.
+  bool reconcile(request_scheduler& scheduler);
+
+  bool isReconciling() const
+  {
+    return reconciling_;
+  }
+
+  // Queues a follow back for every account that followed since the last
+  // update.
+  void update(request_scheduler& scheduler);
+
+  // Sends queued follows and unfollows for as long as there is rate-limit
+  // budget to spare.
+  void drain(request_scheduler& scheduler);
+
+  void store(bot_state& state) const;
+
+  void restore(const bot_state& state);
+
+  std::size_t getPending() const
+  {
+    return pendingFollows_.size() + pendingUnfollows_.size();
+  }
+
+  bool isFriend(std::uint64_t accountId) const
+  {
+    return friends_.contains(accountId);
+  }
+
+  const id_set& getFriends() const
+  {
+    return friends_;
+  }
+
+private:
+
+  // One of the two lists being fetched for a reconciliation.
+  struct account_list {
+    std::map<std::string, std::string> cursor;
+    std::vector<std::uint64_t> ids;
+    bool complete = false;
+  };
+
+  void fetchPage(
+    request_scheduler& scheduler,
+    mastodonpp::API::endpoint_type endpoint,
+    account_list& list);
+
+  const std::string accountId_;
+  id_set friends_;
+  id_set pendingFollows_;
+  id_set pendingUnfollows_;
+
+  // Newest follow notification that has been handled, or zero if there
+  // were none when the cursor was set.
+  bool hasCursor_ = false;
+  std::uint64_t notificationCursor_ = 0;
+
+  bool reconciling_ = false;
+  account_list following_;
+  account_list followers_;
+};
+
+#endif /* end of include guard: FOLLOW_SYNC_H_92D6F3A8 */
@@ -0,0 +1,153 @@
+#include "id_set.h"
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Lookups binary search down to a block this size and then compare the
+// whole block at once.
+const std::size_t SCAN_BLOCK = 16;
+
+namespace {
+
+  // Whether any of the four IDs starting at block equals id.
+  bool anyOfFour(const std::uint64_t* block, std::uint64_t id)
+  {
+#if defined(__SSE2__)
+    // SSE2 has no 64-bit compare, so compare the 32-bit halves and require
+    // both halves of a lane to match.
+    __m128i needle = _mm_set1_epi64x(static_cast<long long>(id));
+    __m128i low = _mm_cmpeq_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block)),
+      needle);
+    __m128i high = _mm_cmpeq_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 2)),
+      needle);
+
+    low = _mm_and_si128(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+    high = _mm_and_si128(
+      high,
+      _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_movemask_epi8(_mm_or_si128(low, high)) != 0;
+#else
+    return block[0] == id || block[1] == id || block[2] == id
+      || block[3] == id;
+#endif
+  }
+
+  // Whether id is in the sorted range [first, first + count).
+  bool scan(const std::uint64_t* first, std::size_t count, std::uint64_t id)
+  {
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+      if (anyOfFour(first + i, id))
+      {
+        return true;
+      }
+    }
+
+    for (; i < count; i++)
+    {
+      if (first[i] == id)
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+}
+
+id_set::id_set(std::vector<std::uint64_t> ids) : ids_(std::move(ids))
+{
+  std::sort(std::begin(ids_), std::end(ids_));
+  ids_.erase(std::unique(std::begin(ids_), std::end(ids_)), std::end(ids_));
+}
+
+bool id_set::contains(std::uint64_t id) const
+{
+  const std::uint64_t* first = ids_.data();
+  std::size_t count = ids_.size();
+
+  // Branchless halving, which keeps the loop free of mispredictions.
+  while (count > SCAN_BLOCK)
+  {
+    std::size_t half = count / 2;
+    first = (first[half] <= id) ? first + half : first;
+    count -= half;
+  }
+
+  return scan(first, count, id);
+}
+
+bool id_set::insert(std::uint64_t id)
+{
+  auto it = std::lower_bound(std::begin(ids_), std::end(ids_), id);
+  if (it != std::end(ids_) && *it == id)
+  {
+    return false;
+  }
+
+  ids_.insert(it, id);
+
+  return true;
+}
+
+bool id_set::erase(std::uint64_t id)
+{
+  auto it = std::lower_bound(std::begin(ids_), std::end(ids_), id);
+  if (it == std::end(ids_) || *it != id)
+  {
+    return false;
+  }
+
+  ids_.erase(it);
+
+  return true;
+}
+
+id_set id_set::difference(const id_set& other) const
+{
+  id_set result;
+  result.ids_.reserve(ids_.size());
+
+  const std::uint64_t* theirs = other.ids_.data();
+  std::size_t theirCount = other.ids_.size();
+  std::size_t j = 0;
+
+  for (std::uint64_t id : ids_)
+  {
+    // Skip whole blocks of smaller IDs. Afterwards, if id is in other at
+    // all, it is in the next block.
+    while (j + 4 <= theirCount && theirs[j + 3] < id)
+    {
+      j += 4;
+    }
+
+    bool found = (j + 4 <= theirCount)
+      ? anyOfFour(theirs + j, id)
+      : scan(theirs + j, theirCount - j, id);
+
+    if (!found)
+    {
+      // Already sorted and unique.
+      result.ids_.push_back(id);
+    }
+  }
+
+  return result;
+}
+
+bool parseId(std::string_view text, std::uint64_t& id)
+{
+  const char* end = text.data() + text.size();
+  auto [ptr, error] = std::from_chars(text.data(), end, id);
+
+  return !text.empty() && error == std::errc() && ptr == end;
+}
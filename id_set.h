@@ -0,0 +1,75 @@
+#ifndef ID_SET_H_C4715E0B
+#define ID_SET_H_C4715E0B
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// A set of Mastodon IDs (account and status IDs are decimal snowflakes that
+// fit in 64 bits) kept as one sorted array. Compared to a std::set of
+// strings there is no per-ID allocation, lookups touch a few cache lines,
+// and the final comparisons of a lookup or a difference are done several
+// IDs at a time with SSE2. Inserting or erasing one ID moves the ones after
+// it, which is fine for the trickle of follows this is used for; build big
+// sets from a vector instead.
+class id_set {
+public:
+
+  using const_iterator = std::vector<std::uint64_t>::const_iterator;
+
+  id_set() = default;
+
+  // Sorts the IDs and drops duplicates.
+  explicit id_set(std::vector<std::uint64_t> ids);
+
+  bool contains(std::uint64_t id) const;
+
+  // Returns false if the ID was already there.
+  bool insert(std::uint64_t id);
+
+  // Returns false if the ID was not there.
+  bool erase(std::uint64_t id);
+
+  // The IDs in this set that are not in other.
+  id_set difference(const id_set& other) const;
+
+  void clear()
+  {
+    ids_.clear();
+  }
+
+  std::size_t size() const
+  {
+    return ids_.size();
+  }
+
+  bool empty() const
+  {
+    return ids_.empty();
+  }
+
+  const_iterator begin() const
+  {
+    return ids_.begin();
+  }
+
+  const_iterator end() const
+  {
+    return ids_.end();
+  }
+
+  bool operator==(const id_set& other) const
+  {
+    return ids_ == other.ids_;
+  }
+
+private:
+
+  std::vector<std::uint64_t> ids_;
+};
+
+// Returns false if the text is not a decimal number that fits in 64 bits.
+bool parseId(std::string_view text, std::uint64_t& id);
+
+#endif /* end of include guard: ID_SET_H_C4715E0B */
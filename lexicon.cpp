@@ -0,0 +1,140 @@
+#include "lexicon.h"
+#include "metrics.h"
+
+lexicon::lexicon(
+  verbly::database& database,
+  std::size_t capacity) :
+    database_(database),
+    capacity_(capacity)
+{
+}
+
+lexicon::lexicon(
+  verbly::database& database,
+  const compiled_lexicon& compiled) :
+    database_(database),
+    compiled_(&compiled),
+    capacity_(0)
+{
+}
+
+std::vector<int> lexicon::lookup(const std::vector<request>& requests)
+{
+  static metrics::histogram& lookupTime = metrics::getHistogram(
+    "father_lexicon_lookup_seconds",
+    "Time spent resolving the words of one post");
+  static metrics::counter& hits = metrics::getCounter(
+    "father_lexicon_cache_hits_total",
+    "Word lookups answered from the cache");
+  static metrics::counter& misses = metrics::getCounter(
+    "father_lexicon_cache_misses_total",
+    "Word lookups that went to the database");
+  static metrics::counter& queries = metrics::getCounter(
+    "father_lexicon_queries_total",
+    "Database queries made by the lexicon");
+
+  metrics::timer lookupTimer(lookupTime);
+
+  std::vector<int> result(requests.size(), -1);
+
+  if (compiled_)
+  {
+    // Already as fast as a cache hit, so there is no cache in front of it.
+    for (std::size_t i = 0; i < requests.size(); i++)
+    {
+      result[i] = compiled_->find(requests[i].form, requests[i].partOfSpeech);
+    }
+
+    return result;
+  }
+
+  std::vector<std::size_t> pending;
+
+  for (std::size_t i = 0; i < requests.size(); i++)
+  {
+    auto it = index_.find({requests[i].form, requests[i].partOfSpeech});
+    if (it != std::end(index_))
+    {
+      entries_.splice(std::begin(entries_), entries_, it->second);
+      result[i] = it->second->second;
+      hits_++;
+      hits.add();
+    } else {
+      pending.push_back(i);
+      misses_++;
+      misses.add();
+    }
+  }
+
+  if (pending.empty())
+  {
+    return result;
+  }
+
+  // One LIMIT 1 query per distinct form and part of speech. A single query
+  // for the whole post would return words without their text, and verbly
+  // fetches each word's lemma, forms and notion separately, so matching the
+  // rows back up to the requests would cost more queries than it saves.
+  // Here the key comes from the request and only the ID is read.
+  std::map<key_type, int> resolved;
+  for (std::size_t i : pending)
+  {
+    key_type key(requests[i].form, requests[i].partOfSpeech);
+    if (resolved.count(key))
+    {
+      continue;
+    }
+
+    queries.add();
+
+    std::vector<verbly::word> found = database_.words(
+      (verbly::notion::partOfSpeech == key.second)
+        && (verbly::form::text == key.first)).all();
+
+    resolved.emplace(
+      std::move(key),
+      found.empty() ? -1 : found.front().getId());
+  }
+
+  for (std::size_t i : pending)
+  {
+    key_type key(requests[i].form, requests[i].partOfSpeech);
+
+    result[i] = resolved[key];
+
+    if (!index_.count(key))
+    {
+      remember(std::move(key), result[i]);
+    }
+  }
+
+  return result;
+}
+
+verbly::word lexicon::getWord(int id)
+{
+  static metrics::counter& loads = metrics::getCounter(
+    "father_lexicon_word_loads_total",
+    "Words loaded from the database to write a reply");
+
+  loads.add();
+
+  return database_.words(verbly::word::id == id).first();
+}
+
+void lexicon::remember(key_type key, int result)
+{
+  if (capacity_ == 0)
+  {
+    return;
+  }
+
+  if (entries_.size() >= capacity_)
+  {
+    index_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+
+  entries_.emplace_front(key, result);
+  index_.emplace(std::move(key), std::begin(entries_));
+}
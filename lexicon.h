@@ -0,0 +1,76 @@
+#ifndef LEXICON_H_3A1C7E52
+#define LEXICON_H_3A1C7E52
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <verbly.h>
+#include "compiled_lexicon.h"
+
+// Finds out which word, if any, a form is in a given part of speech. Forms
+// are resolved to word IDs, either from the database (with an LRU cache in
+// front of it) or from a compiled lexicon file; the database itself is only
+// needed again to load the words that end up in a reply.
+class lexicon {
+public:
+
+  struct request {
+    std::string form;
+    verbly::part_of_speech partOfSpeech;
+  };
+
+  lexicon(verbly::database& database, std::size_t capacity);
+
+  lexicon(verbly::database& database, const compiled_lexicon& compiled);
+
+  // Returns the word ID for each request, in the same order, or -1 where no
+  // word was found. Without a compiled lexicon this makes one small
+  // database query per form and part of speech that is not cached, and
+  // both hits and misses are remembered.
+  std::vector<int> lookup(const std::vector<request>& requests);
+
+  // Loads a word that lookup() found.
+  verbly::word getWord(int id);
+
+  std::size_t getHits() const
+  {
+    return hits_;
+  }
+
+  std::size_t getMisses() const
+  {
+    return misses_;
+  }
+
+  std::size_t getSize() const
+  {
+    return entries_.size();
+  }
+
+  std::size_t getCapacity() const
+  {
+    return capacity_;
+  }
+
+private:
+
+  using key_type = std::pair<std::string, verbly::part_of_speech>;
+  using entry_list = std::list<std::pair<key_type, int>>;
+
+  void remember(key_type key, int result);
+
+  verbly::database& database_;
+  const compiled_lexicon* compiled_ = nullptr;
+  std::size_t capacity_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+
+  // Most recently used entries are kept at the front.
+  entry_list entries_;
+  std::map<key_type, entry_list::iterator> index_;
+};
+
+#endif /* end of include guard: LEXICON_H_3A1C7E52 */
@@ -0,0 +1,265 @@
+#include "metrics.h"
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace metrics {
+
+  namespace {
+
+    template <typename T>
+    struct entry {
+      std::string help;
+      std::unique_ptr<T> metric;
+    };
+
+    struct registry {
+      std::mutex mutex;
+      std::map<std::string, entry<counter>> counters;
+      std::map<std::string, entry<gauge>> gauges;
+      std::map<std::string, entry<histogram>> histograms;
+    };
+
+    registry& getRegistry()
+    {
+      static registry instance;
+
+      return instance;
+    }
+
+    template <typename T>
+    T& find(
+      std::map<std::string, entry<T>>& metrics,
+      const std::string& name,
+      const std::string& help)
+    {
+      std::lock_guard<std::mutex> lock(getRegistry().mutex);
+
+      entry<T>& e = metrics[name];
+      if (!e.metric)
+      {
+        e.help = help;
+        e.metric = std::make_unique<T>();
+      }
+
+      return *e.metric;
+    }
+
+  }
+
+  const std::array<double, histogram::BUCKETS> histogram::BOUNDS = {
+    0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60};
+
+  void histogram::observe(std::chrono::steady_clock::duration elapsed)
+  {
+    std::uint64_t micros =
+      std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    double seconds = micros / 1e6;
+
+    std::size_t bucket = 0;
+    while (bucket < BUCKETS && seconds > BOUNDS[bucket])
+    {
+      bucket++;
+    }
+
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sumMicros_.fetch_add(micros, std::memory_order_relaxed);
+  }
+
+  counter& getCounter(const std::string& name, const std::string& help)
+  {
+    return find(getRegistry().counters, name, help);
+  }
+
+  gauge& getGauge(const std::string& name, const std::string& help)
+  {
+    return find(getRegistry().gauges, name, help);
+  }
+
+  histogram& getHistogram(const std::string& name, const std::string& help)
+  {
+    return find(getRegistry().histograms, name, help);
+  }
+
+  std::string renderPrometheus()
+  {
+    registry& r = getRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    std::ostringstream out;
+
+    for (const auto& [name, e] : r.counters)
+    {
+      out << "# HELP " << name << " " << e.help << "\n"
+        << "# TYPE " << name << " counter\n"
+        << name << " " << e.metric->get() << "\n";
+    }
+
+    for (const auto& [name, e] : r.gauges)
+    {
+      out << "# HELP " << name << " " << e.help << "\n"
+        << "# TYPE " << name << " gauge\n"
+        << name << " " << e.metric->get() << "\n";
+    }
+
+    for (const auto& [name, e] : r.histograms)
+    {
+      out << "# HELP " << name << " " << e.help << "\n"
+        << "# TYPE " << name << " histogram\n";
+
+      std::uint64_t cumulative = 0;
+      for (std::size_t i = 0; i < histogram::BUCKETS; i++)
+      {
+        cumulative += e.metric->getBucket(i);
+        out << name << "_bucket{le=\"" << histogram::BOUNDS[i] << "\"} "
+          << cumulative << "\n";
+      }
+
+      cumulative += e.metric->getBucket(histogram::BUCKETS);
+      out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n"
+        << name << "_sum " << e.metric->getSum() << "\n"
+        << name << "_count " << e.metric->getCount() << "\n";
+    }
+
+    return out.str();
+  }
+
+  std::string renderLogLine()
+  {
+    registry& r = getRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    std::ostringstream out;
+    out << "metrics";
+
+    for (const auto& [name, e] : r.counters)
+    {
+      out << " " << name << "=" << e.metric->get();
+    }
+
+    for (const auto& [name, e] : r.gauges)
+    {
+      out << " " << name << "=" << e.metric->get();
+    }
+
+    for (const auto& [name, e] : r.histograms)
+    {
+      std::uint64_t count = e.metric->getCount();
+
+      out << " " << name << "_count=" << count;
+
+      if (count > 0)
+      {
+        out << " " << name << "_mean_ms=" << std::fixed
+          << std::setprecision(3) << (e.metric->getSum() * 1000 / count)
+          << std::defaultfloat;
+      }
+    }
+
+    return out.str();
+  }
+
+  server::server(int port)
+  {
+    socket_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_ < 0)
+    {
+      throw std::runtime_error(
+        std::string("Could not create metrics socket: ") + std::strerror(errno));
+    }
+
+    int reuse = 1;
+    ::setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (::bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+      || ::listen(socket_, 8) != 0)
+    {
+      std::string error = std::strerror(errno);
+      ::close(socket_);
+
+      throw std::runtime_error("Could not listen for metrics: " + error);
+    }
+
+    thread_ = std::thread(&server::run, this);
+  }
+
+  server::~server()
+  {
+    running_ = false;
+
+    if (thread_.joinable())
+    {
+      thread_.join();
+    }
+
+    ::close(socket_);
+  }
+
+  void server::run()
+  {
+    while (running_)
+    {
+      pollfd listener {socket_, POLLIN, 0};
+      if (::poll(&listener, 1, 1000) <= 0)
+      {
+        continue;
+      }
+
+      int client = ::accept(socket_, nullptr, nullptr);
+      if (client < 0)
+      {
+        continue;
+      }
+
+      // Every request gets the metrics, so the request itself only needs to
+      // be drained, not parsed.
+      char request[1024];
+      pollfd reader {client, POLLIN, 0};
+      if (::poll(&reader, 1, 1000) > 0)
+      {
+        ::recv(client, request, sizeof(request), 0);
+      }
+
+      std::string body = renderPrometheus();
+      std::string response =
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n"
+        "\r\n" + body;
+
+      std::size_t sent = 0;
+      while (sent < response.size())
+      {
+        ssize_t written = ::send(
+          client,
+          response.data() + sent,
+          response.size() - sent,
+          MSG_NOSIGNAL);
+
+        if (written <= 0)
+        {
+          break;
+        }
+
+        sent += written;
+      }
+
+      ::close(client);
+    }
+  }
+
+}
@@ -0,0 +1,151 @@
+#ifndef METRICS_H_B39E6D15
+#define METRICS_H_B39E6D15
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Counters and latency histograms for the hot path. Updates are single
+// relaxed atomic operations, so they are cheap enough to leave on all the
+// time; look a metric up once (e.g. into a function-local static reference)
+// rather than on every update.
+namespace metrics {
+
+  class counter {
+  public:
+
+    void add(std::uint64_t amount = 1)
+    {
+      value_.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const
+    {
+      return value_.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    std::atomic<std::uint64_t> value_ {0};
+  };
+
+  // Like a counter, but can go down, e.g. for queue depths.
+  class gauge {
+  public:
+
+    void set(std::int64_t value)
+    {
+      value_.store(value, std::memory_order_relaxed);
+    }
+
+    std::int64_t get() const
+    {
+      return value_.load(std::memory_order_relaxed);
+    }
+
+  private:
+
+    std::atomic<std::int64_t> value_ {0};
+  };
+
+  // Fixed buckets from half a millisecond up to a minute, which covers
+  // everything from a cached lexicon lookup to a throttled request.
+  class histogram {
+  public:
+
+    static constexpr std::size_t BUCKETS = 12;
+    static const std::array<double, BUCKETS> BOUNDS;
+
+    void observe(std::chrono::steady_clock::duration elapsed);
+
+    std::uint64_t getBucket(std::size_t i) const
+    {
+      return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t getCount() const
+    {
+      return count_.load(std::memory_order_relaxed);
+    }
+
+    double getSum() const
+    {
+      return sumMicros_.load(std::memory_order_relaxed) / 1e6;
+    }
+
+  private:
+
+    // The last bucket is +Inf.
+    std::array<std::atomic<std::uint64_t>, BUCKETS + 1> buckets_ {};
+    std::atomic<std::uint64_t> count_ {0};
+    std::atomic<std::uint64_t> sumMicros_ {0};
+  };
+
+  // Observes the time between its construction and destruction.
+  class timer {
+  public:
+
+    explicit timer(histogram& target) :
+      target_(target),
+      start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    timer(const timer&) = delete;
+    timer& operator=(const timer&) = delete;
+
+    ~timer()
+    {
+      target_.observe(std::chrono::steady_clock::now() - start_);
+    }
+
+  private:
+
+    histogram& target_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  // Metrics are created on first use and live for the rest of the process.
+  counter& getCounter(const std::string& name, const std::string& help);
+
+  gauge& getGauge(const std::string& name, const std::string& help);
+
+  histogram& getHistogram(const std::string& name, const std::string& help);
+
+  // Every metric in the Prometheus text exposition format.
+  std::string renderPrometheus();
+
+  // Every metric on one line as space-separated key=value pairs. Histograms
+  // are reduced to their count and mean.
+  std::string renderLogLine();
+
+  // Serves renderPrometheus() over HTTP on the loopback interface only.
+  class server {
+  public:
+
+    explicit server(int port);
+
+    server(const server&) = delete;
+    server& operator=(const server&) = delete;
+
+    ~server();
+
+  private:
+
+    void run();
+
+    int socket_ = -1;
+    std::atomic<bool> running_ {true};
+    std::thread thread_;
+  };
+
+}
+
+#endif /* end of include guard: METRICS_H_B39E6D15 */
@@ -0,0 +1,397 @@
+#include "normalizer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+  enum class char_class {
+    letter,
+    space,
+    other
+  };
+
+  bool isAsciiAlpha(unsigned char ch)
+  {
+    return ((ch | 0x20) >= 'a') && ((ch | 0x20) <= 'z');
+  }
+
+  char_class classify(char32_t cp)
+  {
+    if (cp < 0x80)
+    {
+      if (isAsciiAlpha(cp))
+      {
+        return char_class::letter;
+      }
+
+      switch (cp)
+      {
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\r':
+        case '\f':
+        case '\v':
+        {
+          return char_class::space;
+        }
+
+        default:
+        {
+          return char_class::other;
+        }
+      }
+    }
+
+    if (cp == 0xA0
+      || (cp >= 0x2000 && cp <= 0x200A)
+      || cp == 0x2028
+      || cp == 0x2029
+      || cp == 0x202F
+      || cp == 0x205F
+      || cp == 0x3000)
+    {
+      return char_class::space;
+    }
+
+    // Latin-1 punctuation and symbols, and the multiplication and division
+    // signs in the middle of the Latin-1 letters.
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7)
+    {
+      return char_class::other;
+    }
+
+    // Alphabetic scripts up to the general punctuation block, kana and CJK,
+    // and hangul. Everything else (punctuation, symbols, emoji, joiners,
+    // variation selectors) is dropped.
+    if (cp < 0x2000
+      || (cp >= 0x3040 && cp <= 0x9FFF)
+      || (cp >= 0xAC00 && cp <= 0xD7AF))
+    {
+      return char_class::letter;
+    }
+
+    return char_class::other;
+  }
+
+  // Decodes one UTF-8 sequence starting at pos. Returns the number of bytes
+  // consumed, which is 1 for an invalid sequence (reported as U+FFFD).
+  std::size_t decodeUtf8(std::string_view text, std::size_t pos, char32_t& cp)
+  {
+    unsigned char lead = text[pos];
+    std::size_t length;
+
+    if (lead < 0x80)
+    {
+      cp = lead;
+      return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF)
+    {
+      length = 2;
+      cp = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+      length = 3;
+      cp = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+      length = 4;
+      cp = lead & 0x07;
+    } else {
+      cp = 0xFFFD;
+      return 1;
+    }
+
+    if (pos + length > text.size())
+    {
+      cp = 0xFFFD;
+      return 1;
+    }
+
+    for (std::size_t i = 1; i < length; i++)
+    {
+      unsigned char cont = text[pos + i];
+      if ((cont & 0xC0) != 0x80)
+      {
+        cp = 0xFFFD;
+        return 1;
+      }
+
+      cp = (cp << 6) | (cont & 0x3F);
+    }
+
+    // Reject overlong encodings, surrogates and out-of-range values.
+    if ((length == 3 && cp < 0x800)
+      || (length == 4 && (cp < 0x10000 || cp > 0x10FFFF))
+      || (cp >= 0xD800 && cp <= 0xDFFF))
+    {
+      cp = 0xFFFD;
+      return 1;
+    }
+
+    return length;
+  }
+
+  // Decodes the entity starting at the '&' at pos. Returns the number of
+  // bytes consumed, or 0 if this is not an entity we understand.
+  std::size_t decodeEntity(std::string_view text, std::size_t pos, char32_t& cp)
+  {
+    std::size_t semi = text.find(';', pos + 1);
+    if (semi == std::string_view::npos || semi - pos > 10)
+    {
+      return 0;
+    }
+
+    std::string_view name = text.substr(pos + 1, semi - pos - 1);
+
+    if (name.size() >= 2 && name[0] == '#')
+    {
+      char32_t value = 0;
+      bool hex = (name[1] == 'x' || name[1] == 'X');
+      std::size_t start = hex ? 2 : 1;
+
+      if (start == name.size())
+      {
+        return 0;
+      }
+
+      for (std::size_t i = start; i < name.size(); i++)
+      {
+        char ch = name[i];
+        int digit;
+
+        if (ch >= '0' && ch <= '9')
+        {
+          digit = ch - '0';
+        } else if (hex && (ch | 0x20) >= 'a' && (ch | 0x20) <= 'f')
+        {
+          digit = (ch | 0x20) - 'a' + 10;
+        } else {
+          return 0;
+        }
+
+        value = value * (hex ? 16 : 10) + digit;
+        if (value > 0x10FFFF)
+        {
+          return 0;
+        }
+      }
+
+      cp = value;
+    } else if (name == "amp")
+    {
+      cp = '&';
+    } else if (name == "lt")
+    {
+      cp = '<';
+    } else if (name == "gt")
+    {
+      cp = '>';
+    } else if (name == "quot")
+    {
+      cp = '"';
+    } else if (name == "apos")
+    {
+      cp = '\'';
+    } else if (name == "nbsp")
+    {
+      cp = 0xA0;
+    } else {
+      return 0;
+    }
+
+    return semi - pos + 1;
+  }
+
+  // Paragraphs and line breaks separate words; inline markup such as links
+  // and spans does not.
+  bool isBreakingTag(std::string_view tag)
+  {
+    std::size_t i = 1;
+    if (i < tag.size() && tag[i] == '/')
+    {
+      i++;
+    }
+
+    std::size_t start = i;
+    while (i < tag.size() && isAsciiAlpha(tag[i]))
+    {
+      i++;
+    }
+
+    std::string_view name = tag.substr(start, i - start);
+
+    return (name.size() == 1 && (name[0] | 0x20) == 'p')
+      || (name.size() == 2
+        && (name[0] | 0x20) == 'b'
+        && (name[1] | 0x20) == 'r');
+  }
+
+}
+
+const std::vector<std::string_view>& normalizer::normalize(
+  std::string_view html)
+{
+  // Nothing below ever writes more bytes than it consumes, so the buffer
+  // never needs to grow while tokens point into it.
+  buffer_.resize(html.size());
+  tokens_.clear();
+  out_ = 0;
+  inToken_ = false;
+
+  std::size_t pos = 0;
+  while (pos < html.size())
+  {
+#if defined(__SSE2__)
+    // Fast path: lowercase a run of ASCII letters sixteen bytes at a time.
+    // Bytes with the high bit set compare as negative and are never letters.
+    if (pos + 16 <= html.size())
+    {
+      __m128i chunk = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(html.data() + pos));
+      __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+      __m128i isLetter = _mm_and_si128(
+        _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+
+      unsigned int mask = _mm_movemask_epi8(isLetter);
+      unsigned int run = (mask == 0xFFFF) ? 16 : __builtin_ctz(~mask);
+
+      if (run > 0)
+      {
+        if (!inToken_)
+        {
+          tokenStart_ = out_;
+          inToken_ = true;
+        }
+
+        // out_ never passes pos, so all sixteen bytes fit in the buffer.
+        _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(&buffer_[out_]),
+          lower);
+
+        out_ += run;
+        pos += run;
+
+        continue;
+      }
+    }
+#endif
+
+    unsigned char ch = html[pos];
+
+    if (ch == '<')
+    {
+      std::size_t close = html.find('>', pos);
+      if (close == std::string_view::npos)
+      {
+        // An unterminated tag swallows the rest of the post.
+        break;
+      }
+
+      if (isBreakingTag(html.substr(pos, close - pos)))
+      {
+        endToken();
+      }
+
+      pos = close + 1;
+    } else if (ch == '&')
+    {
+      char32_t cp;
+      std::size_t length = decodeEntity(html, pos, cp);
+      if (length == 0)
+      {
+        emit('&');
+        pos++;
+      } else {
+        emit(cp);
+        pos += length;
+      }
+    } else if (ch < 0x80)
+    {
+      emit(ch);
+      pos++;
+    } else {
+      char32_t cp;
+      pos += decodeUtf8(html, pos, cp);
+      emit(cp);
+    }
+  }
+
+  endToken();
+
+  return tokens_;
+}
+
+void normalizer::emit(char32_t cp)
+{
+  switch (classify(cp))
+  {
+    case char_class::space:
+    {
+      endToken();
+
+      break;
+    }
+
+    case char_class::other:
+    {
+      if (!inToken_)
+      {
+        tokenStart_ = out_;
+        inToken_ = true;
+      }
+
+      break;
+    }
+
+    case char_class::letter:
+    {
+      if (!inToken_)
+      {
+        tokenStart_ = out_;
+        inToken_ = true;
+      }
+
+      if (cp < 0x80)
+      {
+        buffer_[out_++] = static_cast<char>(cp | 0x20);
+      } else {
+        // Fold the Latin-1 capitals; other scripts are kept as written.
+        if (cp >= 0xC0 && cp <= 0xDE)
+        {
+          cp += 0x20;
+        }
+
+        if (cp < 0x800)
+        {
+          buffer_[out_++] = static_cast<char>(0xC0 | (cp >> 6));
+          buffer_[out_++] = static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000)
+        {
+          buffer_[out_++] = static_cast<char>(0xE0 | (cp >> 12));
+          buffer_[out_++] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+          buffer_[out_++] = static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+          buffer_[out_++] = static_cast<char>(0xF0 | (cp >> 18));
+          buffer_[out_++] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+          buffer_[out_++] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+          buffer_[out_++] = static_cast<char>(0x80 | (cp & 0x3F));
+        }
+      }
+
+      break;
+    }
+  }
+}
+
+void normalizer::endToken()
+{
+  if (inToken_)
+  {
+    tokens_.emplace_back(buffer_.data() + tokenStart_, out_ - tokenStart_);
+    inToken_ = false;
+  }
+}
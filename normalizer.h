@@ -0,0 +1,33 @@
+#ifndef NORMALIZER_H_7D2B94E1
+#define NORMALIZER_H_7D2B94E1
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Turns the HTML content of a post into canonical tokens: markup is
+// stripped, entities are decoded, and each whitespace-separated word is
+// lowercased with everything but its letters removed. A word made only of
+// punctuation still produces an (empty) token so that it separates the
+// words around it.
+class normalizer {
+public:
+
+  // The returned views point into a buffer owned by the normalizer and are
+  // only valid until the next call.
+  const std::vector<std::string_view>& normalize(std::string_view html);
+
+private:
+
+  void emit(char32_t codepoint);
+  void endToken();
+
+  std::string buffer_;
+  std::size_t out_ = 0;
+  std::size_t tokenStart_ = 0;
+  bool inToken_ = false;
+  std::vector<std::string_view> tokens_;
+};
+
+#endif /* end of include guard: NORMALIZER_H_7D2B94E1 */
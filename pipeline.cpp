@@ -0,0 +1,251 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include "metrics.h"
+
+// How many replies the poster sends before waiting on any of them.
+const std::size_t MAX_REPLY_BATCH = 16;
+
+// How often the fetcher checks for a shutdown while it has nothing to do.
+const std::chrono::milliseconds STOP_CHECK_EVERY {250};
+
+namespace {
+
+  metrics::gauge& analysisDepth()
+  {
+    static metrics::gauge& depth = metrics::getGauge(
+      "father_analysis_queue_depth",
+      "Posts waiting for an analyzer");
+
+    return depth;
+  }
+
+  metrics::gauge& replyDepth()
+  {
+    static metrics::gauge& depth = metrics::getGauge(
+      "father_reply_queue_depth",
+      "Replies waiting for the poster");
+
+    return depth;
+  }
+
+}
+
+pipeline::analyzer::analyzer(
+  const std::string& datafile,
+  std::size_t lexiconCacheSize,
+  const compiled_lexicon* compiled,
+  unsigned int seed,
+  const trigger_matcher& triggers) :
+    database(datafile),
+    words(compiled
+      ? lexicon(database, *compiled)
+      : lexicon(database, lexiconCacheSize)),
+    rng(seed),
+    dad(words, rng, triggers)
+{
+}
+
+pipeline::pipeline(
+  std::vector<std::unique_ptr<bot>>& bots,
+  const std::string& datafile,
+  const std::string& lexiconFile,
+  const std::vector<std::string>& triggers,
+  std::size_t analyzers,
+  std::size_t lexiconCacheSize,
+  std::size_t queueCapacity,
+  unsigned int seed) :
+    bots_(bots),
+    triggers_(triggers.empty() ? trigger_matcher() : trigger_matcher(triggers)),
+    analysisQueue_(queueCapacity),
+    replyQueue_(queueCapacity),
+    analyzersRunning_(std::max<std::size_t>(analyzers, 1))
+{
+  if (!lexiconFile.empty())
+  {
+    compiled_ = std::make_unique<compiled_lexicon>(lexiconFile, datafile);
+
+    std::cout << "Mapped " << compiled_->getSize() << " forms from "
+      << lexiconFile << std::endl;
+  }
+
+  // Opened here rather than on the worker threads so that a bad datafile
+  // is reported before anything starts.
+  for (std::size_t i = 0; i < analyzersRunning_; i++)
+  {
+    analyzers_.push_back(
+      std::make_unique<analyzer>(
+        datafile,
+        lexiconCacheSize,
+        compiled_.get(),
+        seed + i,
+        triggers_));
+  }
+}
+
+void pipeline::run(const std::atomic<bool>& stop)
+{
+  std::vector<std::thread> threads;
+
+  for (std::unique_ptr<analyzer>& worker : analyzers_)
+  {
+    threads.emplace_back(&pipeline::analyze, this, std::ref(*worker));
+  }
+
+  threads.emplace_back(&pipeline::send, this);
+
+  // A bot's fetch() can be waiting out a rate limit for minutes, so the
+  // schedulers are stopped as soon as the stop is requested rather than
+  // when the fetcher next checks.
+  std::thread stopper([&] () {
+    while (!stop)
+    {
+      std::this_thread::sleep_for(STOP_CHECK_EVERY);
+    }
+
+    for (std::unique_ptr<bot>& b : bots_)
+    {
+      b->stop();
+    }
+  });
+
+  fetch(stop);
+  stopper.join();
+
+  // Saved before anything else, in case the rest is cut short.
+  for (std::unique_ptr<bot>& b : bots_)
+  {
+    b->flush();
+  }
+
+  std::cout << "Shutting down, sending queued replies that are within the "
+    << "rate limit" << std::endl;
+
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+
+  for (std::unique_ptr<bot>& b : bots_)
+  {
+    b->flush();
+  }
+}
+
+void pipeline::fetch(const std::atomic<bool>& stop)
+{
+  // Every bot runs whenever it is next due, one at a time.
+  std::vector<std::chrono::steady_clock::time_point> due(
+    bots_.size(),
+    std::chrono::steady_clock::now());
+
+  while (!stop)
+  {
+    auto next = std::min_element(std::begin(due), std::end(due));
+
+    if (std::chrono::steady_clock::now() < *next)
+    {
+      std::this_thread::sleep_until(std::min(
+        *next,
+        std::chrono::steady_clock::now() + STOP_CHECK_EVERY));
+
+      continue;
+    }
+
+    std::size_t index = std::distance(std::begin(due), next);
+    bot* target = bots_[index].get();
+
+    std::vector<post> posts;
+    due[index] = target->fetch(posts);
+
+    for (post& status : posts)
+    {
+      // Blocks while the analyzers are behind.
+      analysisQueue_.push({target, std::move(status)});
+      analysisDepth().set(analysisQueue_.size());
+    }
+  }
+
+  analysisQueue_.close();
+}
+
+void pipeline::analyze(analyzer& worker)
+{
+  static metrics::counter& analyzed = metrics::getCounter(
+    "father_posts_analyzed_total",
+    "Posts checked for a reply");
+  static metrics::histogram& analyzeTime = metrics::getHistogram(
+    "father_analyze_seconds",
+    "Time spent deciding on and writing the reply to one post");
+
+  analysis_job job;
+  while (analysisQueue_.pop(job))
+  {
+    analysisDepth().set(analysisQueue_.size());
+    analyzed.add();
+
+    std::string result;
+    try
+    {
+      metrics::timer analyzeTimer(analyzeTime);
+
+      result = worker.dad.respond(job.status);
+    } catch (const std::exception& error)
+    {
+      std::cout << "Error while analyzing post " << job.status.id << ": "
+        << error.what() << std::endl;
+    }
+
+    if (!result.empty())
+    {
+      replyQueue_.push({job.target, {std::move(result), job.status.id}});
+      replyDepth().set(replyQueue_.size());
+    }
+  }
+
+  if (--analyzersRunning_ == 0)
+  {
+    replyQueue_.close();
+  }
+}
+
+void pipeline::send()
+{
+  reply_job job;
+  while (replyQueue_.pop(job))
+  {
+    // Take whatever else is already waiting, grouped by bot in the order
+    // it arrived.
+    std::vector<std::pair<bot*, std::vector<pending_reply>>> batch;
+    std::size_t taken = 0;
+
+    do
+    {
+      auto group = std::find_if(
+        std::begin(batch),
+        std::end(batch),
+        [&] (const auto& entry) {
+          return entry.first == job.target;
+        });
+
+      if (group == std::end(batch))
+      {
+        batch.emplace_back(job.target, std::vector<pending_reply>());
+        group = std::prev(std::end(batch));
+      }
+
+      group->second.push_back(std::move(job.reply));
+      taken++;
+    } while (taken < MAX_REPLY_BATCH && replyQueue_.tryPop(job));
+
+    replyDepth().set(replyQueue_.size());
+
+    for (auto& [target, replies] : batch)
+    {
+      target->sendReplies(replies);
+    }
+  }
+}
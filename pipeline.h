@@ -0,0 +1,98 @@
+#ifndef PIPELINE_H_5B0E73D2
+#define PIPELINE_H_5B0E73D2
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <verbly.h>
+#include "bot.h"
+#include "bounded_queue.h"
+#include "compiled_lexicon.h"
+#include "lexicon.h"
+#include "post.h"
+#include "replier.h"
+#include "trigger_matcher.h"
+
+// Runs the bots as three stages connected by bounded queues:
+//
+//   fetcher -> analyzers (pool) -> poster
+//
+// The fetcher thread does every bot's timeline and follower work. Each
+// analyzer has its own verbly connection and lexicon cache, so workers never
+// share sqlite state; a compiled lexicon, if given, is mapped once and
+// shared by all of them. A single poster thread sends the replies. When a queue
+// fills up the stage feeding it waits, so a slow instance slows down
+// fetching instead of piling up posts.
+class pipeline {
+public:
+
+  // An empty trigger list means the matcher's default phrases, and an empty
+  // lexicon file means words are looked up in the verbly database.
+  pipeline(
+    std::vector<std::unique_ptr<bot>>& bots,
+    const std::string& datafile,
+    const std::string& lexiconFile,
+    const std::vector<std::string>& triggers,
+    std::size_t analyzers,
+    std::size_t lexiconCacheSize,
+    std::size_t queueCapacity,
+    unsigned int seed);
+
+  pipeline(const pipeline&) = delete;
+  pipeline& operator=(const pipeline&) = delete;
+
+  // Runs until stop becomes true. Then the bots stop waiting on rate
+  // limits and their state is saved at once; queued posts still go through
+  // to the poster, but replies that would have to wait are dropped. The
+  // state is saved again before returning.
+  void run(const std::atomic<bool>& stop);
+
+private:
+
+  struct analysis_job {
+    bot* target = nullptr;
+    post status;
+  };
+
+  struct reply_job {
+    bot* target = nullptr;
+    pending_reply reply;
+  };
+
+  struct analyzer {
+    analyzer(
+      const std::string& datafile,
+      std::size_t lexiconCacheSize,
+      const compiled_lexicon* compiled,
+      unsigned int seed,
+      const trigger_matcher& triggers);
+
+    verbly::database database;
+    lexicon words;
+    std::mt19937 rng;
+    replier dad;
+  };
+
+  void fetch(const std::atomic<bool>& stop);
+
+  void analyze(analyzer& worker);
+
+  void send();
+
+  std::vector<std::unique_ptr<bot>>& bots_;
+  const trigger_matcher triggers_;
+  std::unique_ptr<compiled_lexicon> compiled_;
+  std::vector<std::unique_ptr<analyzer>> analyzers_;
+
+  bounded_queue<analysis_job> analysisQueue_;
+  bounded_queue<reply_job> replyQueue_;
+
+  // The last analyzer to finish closes the reply queue.
+  std::atomic<std::size_t> analyzersRunning_;
+};
+
+#endif /* end of include guard: PIPELINE_H_5B0E73D2 */
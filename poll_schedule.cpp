@@ -0,0 +1,94 @@
+#include "poll_schedule.h"
+#include <algorithm>
+#include <cmath>
+#include "metrics.h"
+
+// The old fixed interval, used until there is a rate to go on.
+const std::chrono::minutes DEFAULT_POLL_EVERY {5};
+
+const std::chrono::seconds MIN_POLL_EVERY {30};
+const std::chrono::minutes MAX_POLL_EVERY {15};
+
+// Mastodon returns 20 posts per timeline page by default, and one poll
+// should usually fit in one page.
+const double PAGE_SIZE = 20;
+const double TARGET_POSTS_PER_POLL = PAGE_SIZE * 0.75;
+
+// Timeline polls may use a quarter of the 300 requests per 5 minutes that
+// reads are limited to; the rest is left for follower syncing.
+const double POLL_REQUESTS_PER_SECOND = 300.0 / (5 * 60) / 4;
+
+// How quickly the rate estimate forgets old polls.
+const std::chrono::minutes RATE_TIME_CONSTANT {30};
+
+poll_schedule::poll_schedule() : interval_(DEFAULT_POLL_EVERY)
+{
+}
+
+poll_schedule::clock::duration poll_schedule::update(
+  clock::time_point now,
+  std::size_t posts,
+  bool catchingUp)
+{
+  static metrics::gauge& intervalGauge = metrics::getGauge(
+    "father_poll_interval_seconds",
+    "Current wait between timeline polls");
+
+  if (hasPolled_)
+  {
+    std::chrono::duration<double> elapsed = now - lastPoll_;
+
+    if (elapsed.count() > 0)
+    {
+      double sample = posts / elapsed.count();
+
+      // Weight each sample by how much time it covers, so that polling
+      // more often does not make the average jumpier.
+      double alpha = 1.0 - std::exp(
+        -elapsed / std::chrono::duration<double>(RATE_TIME_CONSTANT));
+
+      rate_ += alpha * (sample - rate_);
+      hasRate_ = true;
+    }
+  }
+
+  // The first poll only resumes from where a previous run stopped, so it
+  // says nothing about the rate.
+  hasPolled_ = true;
+  lastPoll_ = now;
+
+  std::chrono::duration<double> interval = hasRate_
+    ? std::chrono::duration<double>(MAX_POLL_EVERY)
+    : std::chrono::duration<double>(DEFAULT_POLL_EVERY);
+
+  if (rate_ > 0)
+  {
+    interval = std::min<std::chrono::duration<double>>(
+      interval,
+      std::chrono::duration<double>(TARGET_POSTS_PER_POLL / rate_));
+  }
+
+  // A poll costs one request plus one per page of posts, so polling every
+  // t seconds costs 1/t + rate/PAGE_SIZE requests per second.
+  double pageRequests = rate_ / PAGE_SIZE;
+  if (pageRequests < POLL_REQUESTS_PER_SECOND)
+  {
+    interval = std::max<std::chrono::duration<double>>(
+      interval,
+      std::chrono::duration<double>(
+        1.0 / (POLL_REQUESTS_PER_SECOND - pageRequests)));
+  }
+
+  if (catchingUp)
+  {
+    interval = MIN_POLL_EVERY;
+  }
+
+  interval_ = std::chrono::duration_cast<clock::duration>(
+    std::max<std::chrono::duration<double>>(interval, MIN_POLL_EVERY));
+
+  intervalGauge.set(
+    std::chrono::duration_cast<std::chrono::seconds>(interval_).count());
+
+  return interval_;
+}
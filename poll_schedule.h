@@ -0,0 +1,49 @@
+#ifndef POLL_SCHEDULE_H_4F8C21B6
+#define POLL_SCHEDULE_H_4F8C21B6
+
+#include <chrono>
+#include <cstddef>
+
+// Decides how long to wait between timeline polls. The rate of incoming
+// posts is tracked as an exponentially weighted moving average over recent
+// polls, and the interval is chosen so that a poll usually finds about one
+// page of new posts: short on a busy timeline, long on a quiet one. It
+// never polls so often that timeline reads would take more than their
+// share of the rate limit.
+class poll_schedule {
+public:
+
+  using clock = std::chrono::steady_clock;
+
+  poll_schedule();
+
+  // Records a poll that found the given number of new posts and returns how
+  // long to wait before the next one. While the timeline is catching up on
+  // a gap the shortest interval is used. Failed polls should not be
+  // recorded, so that their time counts towards the next successful one.
+  clock::duration update(
+    clock::time_point now,
+    std::size_t posts,
+    bool catchingUp);
+
+  clock::duration getInterval() const
+  {
+    return interval_;
+  }
+
+  // Posts per second.
+  double getRate() const
+  {
+    return rate_;
+  }
+
+private:
+
+  bool hasPolled_ = false;
+  clock::time_point lastPoll_;
+  bool hasRate_ = false;
+  double rate_ = 0;
+  clock::duration interval_;
+};
+
+#endif /* end of include guard: POLL_SCHEDULE_H_4F8C21B6 */
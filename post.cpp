@@ -0,0 +1,235 @@
+#include "post.h"
+#include <cstddef>
+#include <stdexcept>
+#include <json.hpp>
+
+namespace {
+
+  enum class post_field {
+    other,
+    id,
+    content,
+    account,
+    reblog
+  };
+
+  enum class account_field {
+    other,
+    id,
+    acct
+  };
+
+  // Builds posts straight from parser events without materializing a DOM.
+  // Statuses live at depth 1 when the payload is a single object and at
+  // depth 2 when it is an array.
+  class post_handler {
+  public:
+
+    using json = nlohmann::json;
+
+    std::vector<post> posts;
+    std::string error;
+
+    bool null()
+    {
+      return true;
+    }
+
+    bool boolean(bool)
+    {
+      return true;
+    }
+
+    bool number_integer(json::number_integer_t)
+    {
+      return true;
+    }
+
+    bool number_unsigned(json::number_unsigned_t)
+    {
+      return true;
+    }
+
+    bool number_float(json::number_float_t, const json::string_t&)
+    {
+      return true;
+    }
+
+    bool binary(json::binary_t&)
+    {
+      return true;
+    }
+
+    bool string(json::string_t& value)
+    {
+      if (depth_ == statusDepth_)
+      {
+        if (field_ == post_field::id)
+        {
+          current_.id = std::move(value);
+        } else if (field_ == post_field::content)
+        {
+          current_.content = std::move(value);
+        }
+      } else if (inAccount_ && depth_ == statusDepth_ + 1)
+      {
+        if (accountField_ == account_field::id)
+        {
+          current_.accountId = std::move(value);
+        } else if (accountField_ == account_field::acct)
+        {
+          current_.acct = std::move(value);
+        }
+      }
+
+      return true;
+    }
+
+    bool key(json::string_t& name)
+    {
+      if (depth_ == statusDepth_)
+      {
+        if (name == "id")
+        {
+          field_ = post_field::id;
+        } else if (name == "content")
+        {
+          field_ = post_field::content;
+        } else if (name == "account")
+        {
+          field_ = post_field::account;
+        } else if (name == "reblog")
+        {
+          field_ = post_field::reblog;
+        } else {
+          field_ = post_field::other;
+        }
+      } else if (inAccount_ && depth_ == statusDepth_ + 1)
+      {
+        if (name == "id")
+        {
+          accountField_ = account_field::id;
+        } else if (name == "acct")
+        {
+          accountField_ = account_field::acct;
+        } else {
+          accountField_ = account_field::other;
+        }
+      }
+
+      return true;
+    }
+
+    bool start_object(std::size_t)
+    {
+      if (depth_ == 0)
+      {
+        statusDepth_ = 1;
+      }
+
+      depth_++;
+
+      if (depth_ == statusDepth_)
+      {
+        current_ = {};
+        field_ = post_field::other;
+      } else if (depth_ == statusDepth_ + 1)
+      {
+        if (field_ == post_field::account)
+        {
+          inAccount_ = true;
+          accountField_ = account_field::other;
+        } else if (field_ == post_field::reblog)
+        {
+          current_.reblog = true;
+        }
+      }
+
+      return true;
+    }
+
+    bool end_object()
+    {
+      if (depth_ == statusDepth_)
+      {
+        posts.push_back(std::move(current_));
+      } else if (depth_ == statusDepth_ + 1)
+      {
+        inAccount_ = false;
+      }
+
+      depth_--;
+
+      return true;
+    }
+
+    bool start_array(std::size_t)
+    {
+      if (depth_ == 0)
+      {
+        statusDepth_ = 2;
+      }
+
+      depth_++;
+
+      return true;
+    }
+
+    bool end_array()
+    {
+      depth_--;
+
+      return true;
+    }
+
+    bool parse_error(
+      std::size_t,
+      const std::string&,
+      const nlohmann::detail::exception& ex)
+    {
+      error = ex.what();
+
+      return false;
+    }
+
+  private:
+
+    int depth_ = 0;
+    int statusDepth_ = 0;
+    post_field field_ = post_field::other;
+    bool inAccount_ = false;
+    account_field accountField_ = account_field::other;
+    post current_;
+  };
+
+  std::vector<post> parse(std::string_view body)
+  {
+    post_handler handler;
+    if (!nlohmann::json::sax_parse(
+      std::begin(body),
+      std::end(body),
+      &handler))
+    {
+      throw std::runtime_error("Could not parse posts: " + handler.error);
+    }
+
+    return std::move(handler.posts);
+  }
+
+}
+
+std::vector<post> parsePosts(std::string_view body)
+{
+  return parse(body);
+}
+
+post parsePost(std::string_view body)
+{
+  std::vector<post> posts = parse(body);
+  if (posts.size() != 1)
+  {
+    throw std::runtime_error("Expected a single post");
+  }
+
+  return std::move(posts.front());
+}
@@ -0,0 +1,24 @@
+#ifndef POST_H_5B0E2A9D
+#define POST_H_5B0E2A9D
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The parts of a Mastodon status that the bot looks at. Everything else in
+// the payload (media, cards, emoji, ...) is skipped while parsing.
+struct post {
+  std::string id;
+  std::string accountId;
+  std::string acct;
+  bool reblog = false;
+  std::string content;
+};
+
+// Parses a JSON array of statuses, as returned by the timeline endpoints.
+std::vector<post> parsePosts(std::string_view body);
+
+// Parses a single JSON status, as sent by the streaming API.
+post parsePost(std::string_view body);
+
+#endif /* end of include guard: POST_H_5B0E2A9D */
@@ -0,0 +1,129 @@
+#include "replied_filter.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+const std::uint8_t COUNTER_MAX = std::numeric_limits<std::uint8_t>::max();
+
+namespace {
+
+  // splitmix64's finalizer. Status IDs are snowflakes whose low bits barely
+  // change between neighbouring posts, so they need mixing.
+  std::uint64_t mix(std::uint64_t value)
+  {
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+    return value ^ (value >> 31);
+  }
+
+}
+
+replied_filter::replied_filter(
+  std::size_t capacity,
+  double falsePositiveRate) :
+    ring_(std::max<std::size_t>(capacity, 1))
+{
+  if (!(falsePositiveRate > 0.0 && falsePositiveRate < 1.0))
+  {
+    throw std::invalid_argument(
+      "False positive rate must be between 0 and 1");
+  }
+
+  // The usual Bloom filter sizing: m = -n ln p / (ln 2)^2 counters and
+  // k = (m / n) ln 2 hash functions.
+  double ln2 = std::log(2.0);
+  double counters = std::ceil(
+    -static_cast<double>(ring_.size()) * std::log(falsePositiveRate)
+      / (ln2 * ln2));
+
+  counters_.assign(static_cast<std::size_t>(counters), 0);
+  hashes_ = std::max(
+    1u,
+    static_cast<unsigned int>(std::lround(
+      counters / ring_.size() * ln2)));
+}
+
+bool replied_filter::contains(std::uint64_t id) const
+{
+  bool found = true;
+
+  forEachCounter(id, [&] (std::size_t index) {
+    found = found && counters_[index] != 0;
+  });
+
+  return found;
+}
+
+void replied_filter::insert(std::uint64_t id)
+{
+  if (size_ == ring_.size())
+  {
+    forEachCounter(ring_[next_], [&] (std::size_t index) {
+      if (counters_[index] != COUNTER_MAX)
+      {
+        counters_[index]--;
+      }
+    });
+  } else {
+    size_++;
+  }
+
+  ring_[next_] = id;
+  next_ = (next_ + 1) % ring_.size();
+
+  forEachCounter(id, [&] (std::size_t index) {
+    if (counters_[index] != COUNTER_MAX)
+    {
+      counters_[index]++;
+    }
+  });
+}
+
+std::vector<std::uint64_t> replied_filter::getIds() const
+{
+  std::vector<std::uint64_t> result;
+  result.reserve(size_);
+
+  std::size_t oldest = (size_ == ring_.size()) ? next_ : 0;
+  for (std::size_t i = 0; i < size_; i++)
+  {
+    result.push_back(ring_[(oldest + i) % ring_.size()]);
+  }
+
+  return result;
+}
+
+void replied_filter::restore(const std::vector<std::uint64_t>& ids)
+{
+  std::fill(std::begin(counters_), std::end(counters_), 0);
+  next_ = 0;
+  size_ = 0;
+
+  // If the capacity shrank since the IDs were saved, only the newest fit.
+  std::size_t skip = (ids.size() > ring_.size())
+    ? ids.size() - ring_.size()
+    : 0;
+
+  for (std::size_t i = skip; i < ids.size(); i++)
+  {
+    insert(ids[i]);
+  }
+}
+
+template <typename F>
+void replied_filter::forEachCounter(std::uint64_t id, F f) const
+{
+  // Double hashing: the k indexes are h1 + i * h2 (Kirsch and
+  // Mitzenmacher), which is as good as k independent hashes here.
+  std::uint64_t hash = mix(id);
+  std::uint64_t h1 = hash & 0xFFFFFFFFull;
+  std::uint64_t h2 = (hash >> 32) | 1;
+
+  for (unsigned int i = 0; i < hashes_; i++)
+  {
+    f((h1 + i * h2) % counters_.size());
+  }
+}
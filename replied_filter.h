@@ -0,0 +1,54 @@
+#ifndef REPLIED_FILTER_H_93D6B2A4
+#define REPLIED_FILTER_H_93D6B2A4
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Remembers the statuses most recently replied to, so that overlapping
+// timeline pages, a cursor that went backwards or a restart do not lead to
+// a second reply. The last `capacity` IDs are kept in a ring buffer, which
+// is what gets saved, and a counting Bloom filter over the same IDs answers
+// lookups. An ID still in the ring is always found; any other ID is
+// wrongly reported as seen with roughly the configured probability.
+class replied_filter {
+public:
+
+  replied_filter(std::size_t capacity, double falsePositiveRate);
+
+  bool contains(std::uint64_t id) const;
+
+  // Forgets the oldest ID once the ring is full.
+  void insert(std::uint64_t id);
+
+  // Oldest first, in the order restore() expects.
+  std::vector<std::uint64_t> getIds() const;
+
+  void restore(const std::vector<std::uint64_t>& ids);
+
+  std::size_t getSize() const
+  {
+    return size_;
+  }
+
+  std::size_t getCapacity() const
+  {
+    return ring_.size();
+  }
+
+private:
+
+  template <typename F>
+  void forEachCounter(std::uint64_t id, F f) const;
+
+  std::vector<std::uint64_t> ring_;
+  std::size_t next_ = 0;
+  std::size_t size_ = 0;
+
+  // Counters stick at their maximum instead of overflowing, which can only
+  // cause false positives, never a missed duplicate.
+  std::vector<std::uint8_t> counters_;
+  unsigned int hashes_;
+};
+
+#endif /* end of include guard: REPLIED_FILTER_H_93D6B2A4 */
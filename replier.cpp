@@ -0,0 +1,104 @@
+#include "replier.h"
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <vector>
+#include <verbly.h>
+
+replier::replier(
+  lexicon& words,
+  std::mt19937& rng,
+  const trigger_matcher& triggers) :
+    words_(words),
+    rng_(rng),
+    triggers_(triggers)
+{
+}
+
+std::string replier::respond(const post& status)
+{
+  const std::vector<std::string_view>& canonical =
+    normalizer_.normalize(status.content);
+
+  matches_.clear();
+  triggers_.scan(canonical, matches_);
+
+  // The first trigger that is followed by something to describe.
+  auto match = std::find_if(
+    std::begin(matches_),
+    std::end(matches_),
+    [&] (const trigger_match& found) {
+      return found.next < canonical.size();
+    });
+
+  if (match == std::end(matches_))
+  {
+    return {};
+  }
+
+  std::vector<std::string_view>::const_iterator imIt =
+    std::next(std::begin(canonical), match->next);
+
+  std::vector<std::string_view>::const_iterator adjIt = imIt;
+  adjIt++;
+
+  // Resolve every candidate for this post at once.
+  std::vector<lexicon::request> requests = {
+    {std::string(*imIt), verbly::part_of_speech::adverb},
+    {std::string(*imIt), verbly::part_of_speech::adjective}};
+
+  if (adjIt != std::end(canonical))
+  {
+    requests.push_back(
+      {std::string(*adjIt), verbly::part_of_speech::adjective});
+  }
+
+  std::vector<int> found = words_.lookup(requests);
+  int firstAdverb = found[0];
+  int firstAdjective = found[1];
+
+  // Word IDs of the name, decided before any word is loaded, since most
+  // posts do not get a reply in the end.
+  std::vector<int> nameWords;
+
+  if (firstAdverb >= 0 && adjIt != std::end(canonical))
+  {
+    int secondAdjective = found[2];
+
+    if (secondAdjective >= 0)
+    {
+      nameWords = {firstAdverb, secondAdjective};
+    }
+  }
+
+  if (nameWords.empty() && firstAdjective >= 0)
+  {
+    nameWords = {firstAdjective};
+  }
+
+  if (nameWords.empty() || !std::bernoulli_distribution(1.0/10.0)(rng_))
+  {
+    return {};
+  }
+
+  verbly::token name;
+  if (nameWords.size() == 1)
+  {
+    name = words_.getWord(nameWords[0]);
+  } else {
+    for (int id : nameWords)
+    {
+      name << words_.getWord(id);
+    }
+  }
+
+  verbly::token action = {
+    "Hi",
+    verbly::token::punctuation(",",
+      verbly::token::capitalize(
+        verbly::token::casing::title_case,
+        name)),
+    "I'm Dad."};
+
+  return "@" + status.acct + " " + action.compile();
+}
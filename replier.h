@@ -0,0 +1,31 @@
+#ifndef REPLIER_H_84C1D6E0
+#define REPLIER_H_84C1D6E0
+
+#include <random>
+#include <string>
+#include <vector>
+#include "lexicon.h"
+#include "normalizer.h"
+#include "post.h"
+#include "trigger_matcher.h"
+
+// Decides whether a post gets a "Hi X, I'm Dad." reply and writes it.
+class replier {
+public:
+
+  replier(lexicon& words, std::mt19937& rng, const trigger_matcher& triggers);
+
+  // Returns the full reply (including the mention), or an empty string if
+  // this post does not get one.
+  std::string respond(const post& status);
+
+private:
+
+  lexicon& words_;
+  std::mt19937& rng_;
+  const trigger_matcher& triggers_;
+  normalizer normalizer_;
+  std::vector<trigger_match> matches_;
+};
+
+#endif /* end of include guard: REPLIER_H_84C1D6E0 */
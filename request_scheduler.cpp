@@ -0,0 +1,534 @@
+#include "request_scheduler.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <variant>
+#include <curl/curl.h>
+#include "metrics.h"
+
+// Mastodon allows 300 requests per 5 minutes, 300 statuses per 3 hours and
+// 400 follows per day. The buckets are kept slightly under those rates.
+const double READ_BURST = 10;
+const double READ_PER_SECOND = 300.0 / (5 * 60);
+const double STATUS_BURST = 10;
+const double STATUS_PER_SECOND = 300.0 / (3 * 60 * 60);
+const double RELATIONSHIP_BURST = 10;
+const double RELATIONSHIP_PER_SECOND = 400.0 / (24 * 60 * 60);
+
+// Fraction of the server budget that lower priorities leave untouched.
+const double NORMAL_RESERVE = 0.1;
+const double BULK_RESERVE = 0.25;
+
+const int MAX_RETRIES = 4;
+const std::chrono::seconds BACKOFF_BASE {2};
+const std::chrono::minutes BACKOFF_MAX {5};
+
+namespace {
+
+  endpoint_class classify(const mastodonpp::API::endpoint_type& endpoint)
+  {
+    if (const auto* v1 = std::get_if<mastodonpp::API::v1>(&endpoint))
+    {
+      switch (*v1)
+      {
+        case mastodonpp::API::v1::statuses:
+        {
+          return endpoint_class::statuses;
+        }
+
+        case mastodonpp::API::v1::accounts_id_follow:
+        case mastodonpp::API::v1::accounts_id_unfollow:
+        {
+          return endpoint_class::relationships;
+        }
+
+        default:
+        {
+          break;
+        }
+      }
+    }
+
+    return endpoint_class::read;
+  }
+
+  // Finds a header in the raw header block, ignoring case since HTTP/2
+  // servers send them in lowercase.
+  std::string_view findHeader(std::string_view headers, std::string_view name)
+  {
+    std::string_view::size_type pos = 0;
+    while (pos < headers.size())
+    {
+      std::string_view::size_type end = headers.find('\n', pos);
+      if (end == std::string_view::npos)
+      {
+        end = headers.size();
+      }
+
+      std::string_view line = headers.substr(pos, end - pos);
+      pos = end + 1;
+
+      if (line.size() > name.size()
+        && line[name.size()] == ':'
+        && std::equal(
+          std::begin(name),
+          std::end(name),
+          std::begin(line),
+          [] (char left, char right) {
+            return std::tolower(static_cast<unsigned char>(left))
+              == std::tolower(static_cast<unsigned char>(right));
+          }))
+      {
+        std::string_view value = line.substr(name.size() + 1);
+
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.front())))
+        {
+          value.remove_prefix(1);
+        }
+
+        while (!value.empty() && std::isspace(static_cast<unsigned char>(value.back())))
+        {
+          value.remove_suffix(1);
+        }
+
+        return value;
+      }
+    }
+
+    return {};
+  }
+
+  // Parses the ISO 8601 timestamp in X-RateLimit-Reset.
+  bool parseTimestamp(std::string_view text, std::time_t& result)
+  {
+    std::tm parts {};
+    std::string copy(text);
+
+    if (std::sscanf(
+      copy.c_str(),
+      "%d-%d-%dT%d:%d:%d",
+      &parts.tm_year,
+      &parts.tm_mon,
+      &parts.tm_mday,
+      &parts.tm_hour,
+      &parts.tm_min,
+      &parts.tm_sec) != 6)
+    {
+      return false;
+    }
+
+    parts.tm_year -= 1900;
+    parts.tm_mon -= 1;
+    result = timegm(&parts);
+
+    return true;
+  }
+
+  bool shouldRetry(bool isPost, const mastodonpp::answer_type& answer)
+  {
+    if (isPost)
+    {
+      return canResendPost(answer);
+    }
+
+    return answer.curl_error_code != 0
+      || answer.http_status == 429
+      || answer.http_status >= 500;
+  }
+
+  // What a request that was never sent because of stop() returns.
+  mastodonpp::answer_type stoppedAnswer()
+  {
+    mastodonpp::answer_type answer;
+    answer.curl_error_code = CURLE_ABORTED_BY_CALLBACK;
+    answer.error_message = "Shutting down; request not sent";
+
+    return answer;
+  }
+
+}
+
+bool canResendPost(const mastodonpp::answer_type& answer)
+{
+  switch (answer.curl_error_code)
+  {
+    case CURLE_OK:
+    {
+      return answer.http_status == 429;
+    }
+
+    case CURLE_COULDNT_RESOLVE_PROXY:
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    {
+      return true;
+    }
+
+    default:
+    {
+      return false;
+    }
+  }
+}
+
+request_scheduler::request_scheduler(
+  transport& connection,
+  bool paced) :
+    connection_(connection),
+    paced_(paced),
+    rng_(std::random_device{}())
+{
+  clock::time_point now = clock::now();
+
+  auto setBucket = [&] (
+    endpoint_class category,
+    double burst,
+    double perSecond) {
+    bucket& b = buckets_[category];
+    b.tokens = burst;
+    b.capacity = burst;
+    b.perSecond = perSecond;
+    b.refilled = now;
+  };
+
+  setBucket(endpoint_class::read, READ_BURST, READ_PER_SECOND);
+  setBucket(endpoint_class::statuses, STATUS_BURST, STATUS_PER_SECOND);
+  setBucket(
+    endpoint_class::relationships,
+    RELATIONSHIP_BURST,
+    RELATIONSHIP_PER_SECOND);
+}
+
+mastodonpp::answer_type request_scheduler::get(
+  mastodonpp::API::endpoint_type endpoint,
+  const mastodonpp::parametermap& parameters,
+  request_priority priority)
+{
+  return send(false, endpoint, parameters, priority);
+}
+
+mastodonpp::answer_type request_scheduler::post(
+  mastodonpp::API::endpoint_type endpoint,
+  const mastodonpp::parametermap& parameters,
+  request_priority priority)
+{
+  return send(true, endpoint, parameters, priority);
+}
+
+std::future<mastodonpp::answer_type> request_scheduler::getAsync(
+  mastodonpp::API::endpoint_type endpoint,
+  const mastodonpp::parametermap& parameters,
+  request_priority priority)
+{
+  return submit(false, endpoint, parameters, priority);
+}
+
+std::future<mastodonpp::answer_type> request_scheduler::postAsync(
+  mastodonpp::API::endpoint_type endpoint,
+  const mastodonpp::parametermap& parameters,
+  request_priority priority)
+{
+  return submit(true, endpoint, parameters, priority);
+}
+
+bool request_scheduler::hasBudget(
+  mastodonpp::API::endpoint_type endpoint,
+  request_priority priority)
+{
+  if (!paced_)
+  {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const bucket& b = refill(classify(endpoint));
+
+  return b.tokens >= 1.0 && serverAllows(b, priority);
+}
+
+void request_scheduler::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    stopped_ = true;
+  }
+
+  wake_.notify_all();
+}
+
+mastodonpp::answer_type request_scheduler::send(
+  bool isPost,
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters,
+  request_priority priority)
+{
+  static metrics::histogram& requestTime = metrics::getHistogram(
+    "father_http_request_seconds",
+    "Time spent waiting for the instance to answer one request");
+  static metrics::counter& requests = metrics::getCounter(
+    "father_http_requests_total",
+    "Requests sent to the instance");
+  static metrics::counter& retriesCount = metrics::getCounter(
+    "father_http_retries_total",
+    "Requests retried after a rate limit or server error");
+
+  endpoint_class category = classify(endpoint);
+
+  // Bulk requests are not retried here; the caller keeps them queued.
+  int retries = (priority == request_priority::bulk) ? 0 : MAX_RETRIES;
+
+  for (int attempt = 0;; attempt++)
+  {
+    if (!waitForTurn(category, priority))
+    {
+      return stoppedAnswer();
+    }
+
+    requests.add();
+
+    mastodonpp::answer_type answer;
+    {
+      metrics::timer requestTimer(requestTime);
+
+      answer = isPost
+        ? connection_.post(endpoint, parameters)
+        : connection_.get(endpoint, parameters);
+    }
+
+    observe(category, answer);
+
+    if (!shouldRetry(isPost, answer) || attempt >= retries)
+    {
+      return answer;
+    }
+
+    retriesCount.add();
+
+    clock::duration delay;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      delay = backoff(attempt);
+
+      const bucket& b = buckets_.at(category);
+      if (answer.http_status == 429 && b.hasLimit)
+      {
+        delay = std::max(delay, b.reset - clock::now());
+      }
+    }
+
+    std::cout << "Request failed (HTTP " << answer.http_status
+      << "), retrying in "
+      << std::chrono::duration_cast<std::chrono::seconds>(delay).count()
+      << "s" << std::endl;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wake_.wait_for(lock, delay, [this] () { return stopped_; }))
+    {
+      return answer;
+    }
+  }
+}
+
+std::future<mastodonpp::answer_type> request_scheduler::submit(
+  bool isPost,
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters,
+  request_priority priority)
+{
+  static metrics::counter& requests = metrics::getCounter(
+    "father_http_requests_total",
+    "Requests sent to the instance");
+
+  endpoint_class category = classify(endpoint);
+
+  if (!waitForTurn(category, priority))
+  {
+    std::promise<mastodonpp::answer_type> stopped;
+    stopped.set_value(stoppedAnswer());
+
+    return stopped.get_future();
+  }
+
+  requests.add();
+
+  std::future<mastodonpp::answer_type> pending = isPost
+    ? connection_.postAsync(endpoint, parameters)
+    : connection_.getAsync(endpoint, parameters);
+
+  // Deferred, so observe() runs on whichever thread calls get().
+  return std::async(
+    std::launch::deferred,
+    [this, category, pending = std::move(pending)] () mutable {
+      mastodonpp::answer_type answer = pending.get();
+      observe(category, answer);
+
+      return answer;
+    });
+}
+
+request_scheduler::bucket& request_scheduler::refill(endpoint_class category)
+{
+  bucket& b = buckets_.at(category);
+
+  clock::time_point now = clock::now();
+  std::chrono::duration<double> elapsed = now - b.refilled;
+
+  b.tokens = std::min(b.capacity, b.tokens + elapsed.count() * b.perSecond);
+  b.refilled = now;
+
+  return b;
+}
+
+bool request_scheduler::serverAllows(
+  const bucket& b,
+  request_priority priority) const
+{
+  if (!b.hasLimit || clock::now() >= b.reset)
+  {
+    return true;
+  }
+
+  double reserve = 0;
+  switch (priority)
+  {
+    case request_priority::reply:
+    {
+      reserve = 0;
+
+      break;
+    }
+
+    case request_priority::normal:
+    {
+      reserve = NORMAL_RESERVE;
+
+      break;
+    }
+
+    case request_priority::bulk:
+    {
+      reserve = BULK_RESERVE;
+
+      break;
+    }
+  }
+
+  return b.remaining > reserve * b.limit;
+}
+
+bool request_scheduler::waitForTurn(
+  endpoint_class category,
+  request_priority priority)
+{
+  static metrics::histogram& waitTime = metrics::getHistogram(
+    "father_rate_limit_wait_seconds",
+    "Time requests were held back by the rate limiter");
+
+  if (!paced_)
+  {
+    return true;
+  }
+
+  metrics::timer waitTimer(waitTime);
+
+  // Work out how long to wait under the lock. Waiting releases it, so that
+  // other threads can still take tokens from other buckets.
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  for (;;)
+  {
+    clock::time_point until;
+    bucket& b = refill(category);
+
+    if (!serverAllows(b, priority))
+    {
+      until = b.reset;
+    } else if (b.tokens < 1.0)
+    {
+      std::chrono::duration<double> wait((1.0 - b.tokens) / b.perSecond);
+
+      until = clock::now()
+        + std::chrono::duration_cast<clock::duration>(wait);
+    } else {
+      b.tokens -= 1.0;
+
+      if (b.hasLimit && b.remaining > 0)
+      {
+        b.remaining--;
+      }
+
+      return true;
+    }
+
+    if (stopped_)
+    {
+      return false;
+    }
+
+    wake_.wait_until(lock, until, [this] () { return stopped_; });
+  }
+}
+
+void request_scheduler::observe(
+  endpoint_class category,
+  const mastodonpp::answer_type& answer)
+{
+  std::string_view limit = findHeader(answer.headers, "X-RateLimit-Limit");
+  std::string_view remaining =
+    findHeader(answer.headers, "X-RateLimit-Remaining");
+  std::string_view reset = findHeader(answer.headers, "X-RateLimit-Reset");
+
+  std::time_t resetTime;
+  if (limit.empty()
+    || remaining.empty()
+    || !parseTimestamp(reset, resetTime))
+  {
+    return;
+  }
+
+  long parsedLimit;
+  long parsedRemaining;
+  try
+  {
+    parsedLimit = std::stol(std::string(limit));
+    parsedRemaining = std::stol(std::string(remaining));
+  } catch (const std::exception&)
+  {
+    return;
+  }
+
+  // Convert the wall-clock reset time to the monotonic clock used for
+  // waiting.
+  std::chrono::system_clock::duration untilReset =
+    std::chrono::system_clock::from_time_t(resetTime)
+      - std::chrono::system_clock::now();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  bucket& b = buckets_.at(category);
+  b.limit = parsedLimit;
+  b.remaining = parsedRemaining;
+  b.reset = clock::now()
+    + std::chrono::duration_cast<clock::duration>(untilReset);
+  b.hasLimit = true;
+}
+
+request_scheduler::clock::duration request_scheduler::backoff(int attempt)
+{
+  // Somewhere between half and all of an exponentially growing ceiling, so
+  // that clients that failed together do not retry together.
+  std::chrono::duration<double> ceiling =
+    std::min<std::chrono::duration<double>>(
+      BACKOFF_BASE * (1 << attempt),
+      BACKOFF_MAX);
+
+  std::uniform_real_distribution<double> jitter(0.5, 1.0);
+
+  return std::chrono::duration_cast<clock::duration>(ceiling * jitter(rng_));
+}
@@ -0,0 +1,140 @@
+#ifndef REQUEST_SCHEDULER_H_6E3F0B71
+#define REQUEST_SCHEDULER_H_6E3F0B71
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <mastodonpp/mastodonpp.hpp>
+#include "transport.h"
+
+enum class request_priority {
+  // Replies to posts; may use the whole rate-limit budget.
+  reply,
+  // Timeline polls and other requests the loop waits on.
+  normal,
+  // Deferrable work like follow and unfollow requests.
+  bulk
+};
+
+enum class endpoint_class {
+  read,
+  statuses,
+  relationships
+};
+
+// Whether a failed POST certainly had no effect, so that sending it again
+// cannot create a duplicate: it was rate limited, or the connection failed
+// before anything was sent. A timeout or a 5xx may come after the instance
+// already acted on the request.
+bool canResendPost(const mastodonpp::answer_type& answer);
+
+// Every request to the instance goes through here. Requests are paced by a
+// token bucket per endpoint class, the server's own X-RateLimit-* headers
+// are respected, part of the server budget is kept free for higher priority
+// requests, and rate-limited or failed requests are retried with jittered
+// exponential back-off (POSTs only when canResendPost() says so). The
+// scheduler may be shared between threads; it never holds its lock while
+// waiting or while a request is in flight. stop() ends every wait at once.
+class request_scheduler {
+public:
+
+  // An unpaced scheduler never waits for its own buckets, which is only
+  // useful when replaying a recording.
+  explicit request_scheduler(transport& connection, bool paced = true);
+
+  mastodonpp::answer_type get(
+    mastodonpp::API::endpoint_type endpoint,
+    const mastodonpp::parametermap& parameters,
+    request_priority priority = request_priority::normal);
+
+  mastodonpp::answer_type post(
+    mastodonpp::API::endpoint_type endpoint,
+    const mastodonpp::parametermap& parameters,
+    request_priority priority = request_priority::normal);
+
+  // Like get() and post(), but returns as soon as the request has been
+  // handed to the transport. These are not retried; the rate-limit headers
+  // are read when the future is waited on.
+  std::future<mastodonpp::answer_type> getAsync(
+    mastodonpp::API::endpoint_type endpoint,
+    const mastodonpp::parametermap& parameters,
+    request_priority priority = request_priority::normal);
+
+  std::future<mastodonpp::answer_type> postAsync(
+    mastodonpp::API::endpoint_type endpoint,
+    const mastodonpp::parametermap& parameters,
+    request_priority priority = request_priority::normal);
+
+  // Whether a request could be sent right now without waiting. Bulk work
+  // should check this and stay queued instead of blocking the loop.
+  bool hasBudget(
+    mastodonpp::API::endpoint_type endpoint,
+    request_priority priority);
+
+  // Cuts short every wait for a rate limit or a retry, which can last
+  // minutes. From then on a request that would have to wait fails without
+  // being sent (with CURLE_ABORTED_BY_CALLBACK). Used when shutting down.
+  void stop();
+
+private:
+
+  using clock = std::chrono::steady_clock;
+
+  struct bucket {
+    double tokens;
+    double capacity;
+    double perSecond;
+    clock::time_point refilled;
+
+    // Last known state of the server's rate limit for this class. Mastodon
+    // reports the statuses and follows limits in place of the general one
+    // on those endpoints, so each class keeps its own.
+    bool hasLimit = false;
+    long limit = 0;
+    long remaining = 0;
+    clock::time_point reset;
+  };
+
+  mastodonpp::answer_type send(
+    bool isPost,
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters,
+    request_priority priority);
+
+  std::future<mastodonpp::answer_type> submit(
+    bool isPost,
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters,
+    request_priority priority);
+
+  bucket& refill(endpoint_class category);
+
+  bool serverAllows(const bucket& b, request_priority priority) const;
+
+  // Returns false if the scheduler was stopped instead.
+  bool waitForTurn(endpoint_class category, request_priority priority);
+
+  void observe(
+    endpoint_class category,
+    const mastodonpp::answer_type& answer);
+
+  clock::duration backoff(int attempt);
+
+  transport& connection_;
+  const bool paced_;
+
+  // Guards everything below.
+  std::mutex mutex_;
+  std::map<endpoint_class, bucket> buckets_;
+  std::mt19937 rng_;
+  bool stopped_ = false;
+
+  // Signalled by stop(), for everything waiting on the rate limit.
+  std::condition_variable wake_;
+};
+
+#endif /* end of include guard: REQUEST_SCHEDULER_H_6E3F0B71 */
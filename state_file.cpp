@@ -0,0 +1,198 @@
+#include "state_file.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+// Bump this whenever the layout below changes, and keep reading the old
+// versions for as long as anyone might still have them on disk.
+const int STATE_VERSION = 2;
+const char* const STATE_MAGIC = "father-state";
+
+namespace {
+
+  void writeSet(
+    std::ostream& out,
+    const char* name,
+    const id_set& values)
+  {
+    out << name << " " << values.size() << "\n";
+    for (std::uint64_t value : values)
+    {
+      out << value << "\n";
+    }
+  }
+
+  void readSet(
+    std::istream& in,
+    std::size_t count,
+    id_set& values)
+  {
+    std::vector<std::uint64_t> ids;
+    ids.reserve(count);
+
+    std::string value;
+    for (std::size_t i = 0; i < count; i++)
+    {
+      std::uint64_t id;
+      if (!std::getline(in, value) || !parseId(value, id))
+      {
+        throw std::runtime_error("State file is truncated");
+      }
+
+      ids.push_back(id);
+    }
+
+    values = id_set(std::move(ids));
+  }
+
+}
+
+bool loadState(const std::string& path, bot_state& state)
+{
+  std::ifstream in(path);
+  if (!in)
+  {
+    return false;
+  }
+
+  std::string magic;
+  int version = 0;
+  in >> magic >> version;
+  if (magic != STATE_MAGIC)
+  {
+    throw std::runtime_error("Not a state file: " + path);
+  }
+
+  // Version 2 only added the replied list, so version 1 files read fine.
+  if (version < 1 || version > STATE_VERSION)
+  {
+    throw std::runtime_error(
+      "Unsupported state file version " + std::to_string(version));
+  }
+
+  std::string line;
+  std::getline(in, line);
+
+  bot_state result;
+  while (std::getline(in, line))
+  {
+    std::istringstream fields(line);
+    std::string key;
+    fields >> key;
+
+    if (key == "since")
+    {
+      fields >> result.timelineSinceId;
+    } else if (key == "notifications")
+    {
+      result.hasNotificationCursor = true;
+      fields >> result.notificationCursor;
+    } else if (key == "reconciled")
+    {
+      long long seconds = 0;
+      fields >> seconds;
+      result.lastReconcile = static_cast<std::time_t>(seconds);
+    } else if (key == "friends" || key == "follow" || key == "unfollow")
+    {
+      std::size_t count = 0;
+      fields >> count;
+
+      if (key == "friends")
+      {
+        readSet(in, count, result.friends);
+      } else if (key == "follow")
+      {
+        readSet(in, count, result.pendingFollows);
+      } else {
+        readSet(in, count, result.pendingUnfollows);
+      }
+    } else if (key == "replied")
+    {
+      std::size_t count = 0;
+      fields >> count;
+
+      result.repliedIds.clear();
+      result.repliedIds.reserve(count);
+
+      for (std::size_t i = 0; i < count; i++)
+      {
+        std::uint64_t id;
+        if (!(in >> id))
+        {
+          throw std::runtime_error("State file is truncated");
+        }
+
+        result.repliedIds.push_back(id);
+      }
+
+      // Skip the end of the last ID's line.
+      in >> std::ws;
+    } else if (key == "end")
+    {
+      state = std::move(result);
+
+      return true;
+    }
+  }
+
+  throw std::runtime_error("State file is truncated");
+}
+
+void saveState(const std::string& path, const bot_state& state)
+{
+  std::ostringstream out;
+  out << STATE_MAGIC << " " << STATE_VERSION << "\n";
+
+  if (state.timelineSinceId != 0)
+  {
+    out << "since " << state.timelineSinceId << "\n";
+  }
+
+  if (state.hasNotificationCursor)
+  {
+    out << "notifications " << state.notificationCursor << "\n";
+  }
+
+  out << "reconciled " << static_cast<long long>(state.lastReconcile) << "\n";
+
+  writeSet(out, "friends", state.friends);
+  writeSet(out, "follow", state.pendingFollows);
+  writeSet(out, "unfollow", state.pendingUnfollows);
+
+  out << "replied " << state.repliedIds.size() << "\n";
+  for (std::uint64_t id : state.repliedIds)
+  {
+    out << id << "\n";
+  }
+
+  out << "end\n";
+
+  std::string contents = out.str();
+  std::string tempPath = path + ".tmp";
+
+  std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+  if (!file)
+  {
+    throw std::runtime_error(
+      "Could not open " + tempPath + ": " + std::strerror(errno));
+  }
+
+  bool ok = std::fwrite(contents.data(), 1, contents.size(), file)
+      == contents.size()
+    && std::fflush(file) == 0
+    && ::fsync(fileno(file)) == 0;
+
+  ok = (std::fclose(file) == 0) && ok;
+
+  if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0)
+  {
+    std::remove(tempPath.c_str());
+
+    throw std::runtime_error(
+      "Could not write " + path + ": " + std::strerror(errno));
+  }
+}
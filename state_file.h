@@ -0,0 +1,37 @@
+#ifndef STATE_FILE_H_0F7A3C5E
+#define STATE_FILE_H_0F7A3C5E
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "id_set.h"
+
+// Everything needed for a restarted process to pick up where the previous
+// one stopped.
+struct bot_state {
+  // Zero until a post has been seen.
+  std::uint64_t timelineSinceId = 0;
+
+  // Zero if there were no notifications when the cursor was set.
+  bool hasNotificationCursor = false;
+  std::uint64_t notificationCursor = 0;
+
+  std::time_t lastReconcile = 0;
+  id_set friends;
+  id_set pendingFollows;
+  id_set pendingUnfollows;
+
+  // Statuses recently replied to, oldest first.
+  std::vector<std::uint64_t> repliedIds;
+};
+
+// Returns false if there is no state file yet. Throws if the file exists
+// but cannot be read or was written by an incompatible version.
+bool loadState(const std::string& path, bot_state& state);
+
+// Writes to a temporary file and renames it over the old one, so a crash
+// never leaves a half-written state behind.
+void saveState(const std::string& path, const bot_state& state);
+
+#endif /* end of include guard: STATE_FILE_H_0F7A3C5E */
@@ -2,17 +2,53 @@
 #include <sstream>
 #include <hkutil/string.h>
 #include <iostream>
+#include <iterator>
+#include <algorithm>
+#include "id_set.h"
+#include "metrics.h"
+
+// Pages read from the top of the timeline on each poll.
+const int MAX_PAGES = 5;
+
+// Pages read from an open gap on each poll, on top of MAX_PAGES.
+const int CATCH_UP_PAGES = 5;
+
+namespace {
+
+  std::uint64_t getId(const post& status)
+  {
+    std::uint64_t id = 0;
+    parseId(status.id, id);
+
+    return id;
+  }
+
+}
 
 timeline::timeline(mastodonpp::API::endpoint_type endpoint) : endpoint_(endpoint)
 {
 }
 
-std::list<nlohmann::json> timeline::poll(mastodonpp::Connection& connection)
+std::vector<post> timeline::poll(request_scheduler& scheduler)
 {
+  static metrics::histogram& pollTime = metrics::getHistogram(
+    "father_timeline_poll_seconds",
+    "Time spent fetching and parsing one timeline poll");
+  static metrics::counter& gaps = metrics::getCounter(
+    "father_timeline_gaps_total",
+    "Polls that hit the page cap before reaching the last post seen");
+
+  metrics::timer pollTimer(pollTime);
+
+  lastPollFailed_ = true;
+  lastNewPosts_ = 0;
+
   std::string maxId;
-  std::list<nlohmann::json> result;
+  std::string sinceId = std::to_string(sinceId_);
+  std::vector<post> result;
+  bool reachedEnd = false;
 
-  for (int i = 0; i < 5; i++)
+  for (int i = 0; i < MAX_PAGES; i++)
   {
     mastodonpp::parametermap arguments;
 
@@ -23,44 +59,156 @@ std::list<nlohmann::json> timeline::poll(mastodonpp::Connection& connection)
 
     if (hasSince_)
     {
-      arguments["since_id"] = sinceId_;
+      arguments["since_id"] = sinceId;
     }
 
-    auto answer{connection.get(endpoint_, arguments)};
-    if (!answer)
+    std::vector<post> page;
+    if (!fetchPage(scheduler, arguments, page))
     {
-      if (answer.curl_error_code == 0)
-      {
-        std::cout << "HTTP status: " << answer.http_status << std::endl;
-      }
-      else
-      {
-        std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
-             << ": " << answer.error_message << std::endl;
-      }
       return {};
     }
 
-    nlohmann::json rjs = nlohmann::json::parse(answer.body);
-
-    if (rjs.empty())
+    if (page.empty())
     {
+      reachedEnd = true;
+
       break;
     }
 
-    for (auto& single : rjs)
-    {
-      result.push_back(single);
-    }
+    result.insert(
+      std::end(result),
+      std::make_move_iterator(std::begin(page)),
+      std::make_move_iterator(std::end(page)));
 
-    maxId = result.back()["id"].get<std::string>();
+    maxId = result.back().id;
   }
 
+  lastPollFailed_ = false;
+  lastNewPosts_ = result.size();
+
   if (!result.empty())
   {
-    sinceId_ = result.front()["id"].get<std::string>();
+    if (!reachedEnd && hasSince_)
+    {
+      gaps.add();
+
+      // If a gap is already open, this one joins it. The posts read since
+      // in between get read again, which the reply filter absorbs.
+      if (!hasGap_)
+      {
+        gapLow_ = sinceId_;
+        hasGap_ = true;
+      }
+
+      gapHigh_ = getId(result.back());
+    }
+
+    sinceId_ = getId(result.front());
     hasSince_ = true;
   }
 
+  if (hasGap_)
+  {
+    catchUp(scheduler, result);
+  }
+
   return result;
 }
+
+void timeline::catchUp(request_scheduler& scheduler, std::vector<post>& result)
+{
+  static metrics::counter& catchUpPages = metrics::getCounter(
+    "father_timeline_catch_up_pages_total",
+    "Pages read to close a gap in the timeline");
+
+  for (int i = 0; i < CATCH_UP_PAGES; i++)
+  {
+    // min_id pages upwards from the bottom of the gap, so the oldest
+    // missed posts come first.
+    std::string minId = std::to_string(gapLow_);
+    std::string maxId = std::to_string(gapHigh_);
+
+    mastodonpp::parametermap arguments{
+      {"min_id", minId},
+      {"max_id", maxId}};
+
+    std::vector<post> page;
+    if (!fetchPage(scheduler, arguments, page))
+    {
+      // Try again next poll.
+      return;
+    }
+
+    catchUpPages.add();
+
+    if (page.empty())
+    {
+      hasGap_ = false;
+      gapLow_ = 0;
+      gapHigh_ = 0;
+
+      return;
+    }
+
+    for (const post& status : page)
+    {
+      gapLow_ = std::max(gapLow_, getId(status));
+    }
+
+    result.insert(
+      std::end(result),
+      std::make_move_iterator(std::begin(page)),
+      std::make_move_iterator(std::end(page)));
+  }
+}
+
+bool timeline::fetchPage(
+  request_scheduler& scheduler,
+  const mastodonpp::parametermap& arguments,
+  std::vector<post>& page)
+{
+  static metrics::histogram& parseTime = metrics::getHistogram(
+    "father_post_parse_seconds",
+    "Time spent parsing one page of posts");
+  static metrics::counter& pages = metrics::getCounter(
+    "father_timeline_pages_total",
+    "Timeline pages fetched");
+  static metrics::counter& fetched = metrics::getCounter(
+    "father_posts_fetched_total",
+    "Posts returned by timeline polls");
+
+  auto answer{scheduler.get(endpoint_, arguments)};
+  if (!answer)
+  {
+    if (answer.curl_error_code == 0)
+    {
+      std::cout << "HTTP status: " << answer.http_status << std::endl;
+    }
+    else
+    {
+      std::cout << "libcurl error " << std::to_string(answer.curl_error_code)
+           << ": " << answer.error_message << std::endl;
+    }
+    return false;
+  }
+
+  pages.add();
+
+  {
+    metrics::timer parseTimer(parseTime);
+    page = parsePosts(answer.body);
+  }
+
+  fetched.add(page.size());
+
+  return true;
+}
+
+void timeline::advance(std::uint64_t id)
+{
+  if (!hasSince_ || id > sinceId_)
+  {
+    sinceId_ = id;
+    hasSince_ = true;
+  }
+}
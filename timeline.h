@@ -1,24 +1,78 @@
 #ifndef TIMELINE_H_FE90F0DC
 #define TIMELINE_H_FE90F0DC
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <list>
 #include <string>
 #include <mastodonpp/mastodonpp.hpp>
-#include <json.hpp>
+#include <vector>
+#include "post.h"
+#include "request_scheduler.h"
 
+// Polls a timeline for posts newer than the last one seen. A poll reads at
+// most a few pages from the top; if that does not reach the last post seen,
+// the posts in between are kept as a gap and paged through (oldest first)
+// on the following polls until it is closed, instead of being skipped.
 class timeline {
 public:
 
   explicit timeline(mastodonpp::API::endpoint_type endpoint);
 
-  std::list<nlohmann::json> poll(mastodonpp::Connection& connection);
+  std::vector<post> poll(request_scheduler& scheduler);
+
+  // Records a post that was seen some other way (e.g. streamed), so that the
+  // next poll only returns posts newer than it.
+  void advance(std::uint64_t id);
+
+  // Where a restarted process should resume from. Zero until the first
+  // post has been seen. While a gap is open this is the bottom of the gap,
+  // so that a restart pages through it again.
+  std::uint64_t getSinceId() const
+  {
+    return hasGap_ ? gapLow_ : sinceId_;
+  }
+
+  bool isCatchingUp() const
+  {
+    return hasGap_;
+  }
+
+  // Whether the last poll could not read the top of the timeline. A failed
+  // poll returns nothing and leaves the cursor where it was.
+  bool didLastPollFail() const
+  {
+    return lastPollFailed_;
+  }
+
+  // How many posts the last poll found above the last post seen before it.
+  // Older posts read from a gap are not counted.
+  std::size_t getLastNewPosts() const
+  {
+    return lastNewPosts_;
+  }
 
 private:
 
+  // Returns false if the request failed.
+  bool fetchPage(
+    request_scheduler& scheduler,
+    const mastodonpp::parametermap& arguments,
+    std::vector<post>& page);
+
+  void catchUp(request_scheduler& scheduler, std::vector<post>& result);
+
   mastodonpp::API::endpoint_type endpoint_;
   bool hasSince_ = false;
-  std::string sinceId_;
+  std::uint64_t sinceId_ = 0;
+
+  // Posts newer than gapLow_ and older than gapHigh_ have not been read.
+  bool hasGap_ = false;
+  std::uint64_t gapLow_ = 0;
+  std::uint64_t gapHigh_ = 0;
+
+  bool lastPollFailed_ = false;
+  std::size_t lastNewPosts_ = 0;
 };
 
 #endif /* end of include guard: TIMELINE_H_FE90F0DC */
@@ -0,0 +1,287 @@
+#include "timeline_stream.h"
+#include <algorithm>
+#include <curl/curl.h>
+#include <iostream>
+
+// Delay before reconnecting, doubled after every failed attempt.
+const std::chrono::seconds MIN_RECONNECT_DELAY {1};
+const std::chrono::seconds MAX_RECONNECT_DELAY {60};
+
+timeline_stream::timeline_stream(
+  std::string url,
+  std::string accessToken) :
+    url_(std::move(url)),
+    authorization_("Authorization: Bearer " + accessToken)
+{
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+timeline_stream::~timeline_stream()
+{
+  stop();
+
+  curl_global_cleanup();
+}
+
+void timeline_stream::start()
+{
+  if (running_)
+  {
+    return;
+  }
+
+  running_ = true;
+  thread_ = std::thread(&timeline_stream::run, this);
+}
+
+void timeline_stream::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+
+  cond_.notify_all();
+
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+std::vector<post> timeline_stream::wait(
+  std::chrono::milliseconds timeout)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  cond_.wait_for(lock, timeout, [this] () {
+    return !pending_.empty() || reconnected_;
+  });
+
+  std::vector<post> result;
+  result.swap(pending_);
+
+  return result;
+}
+
+bool timeline_stream::takeReconnected()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  bool result = reconnected_;
+  reconnected_ = false;
+
+  return result;
+}
+
+void timeline_stream::run()
+{
+  std::chrono::seconds delay = MIN_RECONNECT_DELAY;
+
+  while (running_)
+  {
+    connect();
+
+    if (!running_)
+    {
+      break;
+    }
+
+    if (connected_)
+    {
+      delay = MIN_RECONNECT_DELAY;
+    } else {
+      delay = std::min(delay * 2, MAX_RECONNECT_DELAY);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait_for(lock, delay, [this] () {
+      return !running_;
+    });
+  }
+}
+
+void timeline_stream::connect()
+{
+  CURL* curl = curl_easy_init();
+  if (!curl)
+  {
+    return;
+  }
+
+  curl_ = curl;
+  connected_ = false;
+  line_.clear();
+  eventType_.clear();
+  eventData_.clear();
+
+  curl_slist* headers = nullptr;
+  headers = curl_slist_append(headers, authorization_.c_str());
+  headers = curl_slist_append(headers, "Accept: text/event-stream");
+
+  curl_easy_setopt(curl, CURLOPT_URL, url_.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &timeline_stream::receive);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &timeline_stream::progress);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+
+  // The server sends a heartbeat comment every few seconds, so a stream
+  // that has been silent for a minute is dead.
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+
+  CURLcode code = curl_easy_perform(curl);
+  if (running_)
+  {
+    if (code != CURLE_OK)
+    {
+      std::cout << "Stream disconnected: " << curl_easy_strerror(code)
+        << std::endl;
+    } else {
+      std::cout << "Stream closed by server" << std::endl;
+    }
+  }
+
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(curl);
+  curl_ = nullptr;
+}
+
+std::size_t timeline_stream::receive(
+  char* data,
+  std::size_t size,
+  std::size_t count,
+  void* userdata)
+{
+  timeline_stream& stream = *static_cast<timeline_stream*>(userdata);
+
+  if (!stream.connected_)
+  {
+    long status = 0;
+    curl_easy_getinfo(stream.curl_, CURLINFO_RESPONSE_CODE, &status);
+    if (status != 200)
+    {
+      std::cout << "Stream HTTP status: " << status << std::endl;
+
+      // Returning a short count aborts the transfer.
+      return 0;
+    }
+
+    stream.connected_ = true;
+
+    {
+      std::lock_guard<std::mutex> lock(stream.mutex_);
+      stream.reconnected_ = true;
+    }
+
+    stream.cond_.notify_all();
+  }
+
+  stream.feed(std::string_view(data, size * count));
+
+  return size * count;
+}
+
+int timeline_stream::progress(
+  void* userdata,
+  long long,
+  long long,
+  long long,
+  long long)
+{
+  timeline_stream& stream = *static_cast<timeline_stream*>(userdata);
+
+  return stream.running_ ? 0 : 1;
+}
+
+void timeline_stream::feed(std::string_view chunk)
+{
+  for (char ch : chunk)
+  {
+    if (ch == '\n')
+    {
+      if (!line_.empty() && line_.back() == '\r')
+      {
+        line_.pop_back();
+      }
+
+      handleLine(line_);
+      line_.clear();
+    } else {
+      line_.push_back(ch);
+    }
+  }
+}
+
+void timeline_stream::handleLine(std::string_view line)
+{
+  if (line.empty())
+  {
+    dispatch();
+
+    return;
+  }
+
+  if (line.front() == ':')
+  {
+    // Comment, used by the server as a heartbeat.
+    return;
+  }
+
+  std::string_view field = line;
+  std::string_view value;
+
+  std::string_view::size_type colon = line.find(':');
+  if (colon != std::string_view::npos)
+  {
+    field = line.substr(0, colon);
+    value = line.substr(colon + 1);
+
+    if (!value.empty() && value.front() == ' ')
+    {
+      value.remove_prefix(1);
+    }
+  }
+
+  if (field == "event")
+  {
+    eventType_ = value;
+  } else if (field == "data")
+  {
+    if (!eventData_.empty())
+    {
+      eventData_.push_back('\n');
+    }
+
+    eventData_.append(value);
+  }
+}
+
+void timeline_stream::dispatch()
+{
+  if (eventType_ == "update" && !eventData_.empty())
+  {
+    try
+    {
+      post status = parsePost(eventData_);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(std::move(status));
+      }
+
+      cond_.notify_all();
+    } catch (const std::exception& error)
+    {
+      std::cout << "Could not parse streamed post: " << error.what()
+        << std::endl;
+    }
+  }
+
+  eventType_.clear();
+  eventData_.clear();
+}
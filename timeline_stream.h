@@ -0,0 +1,86 @@
+#ifndef TIMELINE_STREAM_H_C4E81B07
+#define TIMELINE_STREAM_H_C4E81B07
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "post.h"
+
+// Receives posts from a Mastodon server-sent event stream (such as
+// /api/v1/streaming/user) on a background thread. Dropped connections are
+// retried with an increasing delay; after every (re)connection the caller
+// is told to catch up on whatever was missed using the regular timeline.
+class timeline_stream {
+public:
+
+  timeline_stream(std::string url, std::string accessToken);
+
+  timeline_stream(const timeline_stream&) = delete;
+  timeline_stream& operator=(const timeline_stream&) = delete;
+
+  ~timeline_stream();
+
+  void start();
+
+  void stop();
+
+  // Blocks until at least one post has arrived, the stream has reconnected,
+  // or the timeout passes, and returns the posts received so far.
+  std::vector<post> wait(std::chrono::milliseconds timeout);
+
+  // Returns true once for every time the stream (re)connected since the
+  // last call. Posts published while disconnected are not replayed by the
+  // server, so this is the cue to backfill with since_id.
+  bool takeReconnected();
+
+private:
+
+  static std::size_t receive(
+    char* data,
+    std::size_t size,
+    std::size_t count,
+    void* userdata);
+
+  static int progress(
+    void* userdata,
+    long long dltotal,
+    long long dlnow,
+    long long ultotal,
+    long long ulnow);
+
+  void run();
+
+  void connect();
+
+  void feed(std::string_view chunk);
+
+  void handleLine(std::string_view line);
+
+  void dispatch();
+
+  const std::string url_;
+  const std::string authorization_;
+
+  std::thread thread_;
+  std::atomic<bool> running_ {false};
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<post> pending_;
+  bool reconnected_ = false;
+
+  // Parser state, only touched by the stream thread.
+  void* curl_ = nullptr;
+  bool connected_ = false;
+  std::string line_;
+  std::string eventType_;
+  std::string eventData_;
+};
+
+#endif /* end of include guard: TIMELINE_STREAM_H_C4E81B07 */
@@ -0,0 +1,242 @@
+#include "transport.h"
+#include <stdexcept>
+
+namespace {
+
+  std::future<mastodonpp::answer_type> ready(mastodonpp::answer_type answer)
+  {
+    std::promise<mastodonpp::answer_type> promise;
+    promise.set_value(std::move(answer));
+
+    return promise.get_future();
+  }
+
+  // Each recorded exchange is a header line followed by the raw response
+  // headers and body:
+  //
+  //   <method> <endpoint> <http status> <header bytes> <body bytes>\n
+  //   <headers><body>\n
+  std::string endpointKey(
+    const std::string& method,
+    const mastodonpp::API::endpoint_type& endpoint)
+  {
+    return method + " "
+      + std::string(mastodonpp::API{endpoint}.to_string_view());
+  }
+
+}
+
+std::future<mastodonpp::answer_type> transport::getAsync(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return ready(get(endpoint, parameters));
+}
+
+std::future<mastodonpp::answer_type> transport::postAsync(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return ready(post(endpoint, parameters));
+}
+
+connection_transport::connection_transport(
+  mastodonpp::Connection& connection) :
+    connection_(connection)
+{
+}
+
+mastodonpp::answer_type connection_transport::get(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return connection_.get(endpoint, parameters);
+}
+
+mastodonpp::answer_type connection_transport::post(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return connection_.post(endpoint, parameters);
+}
+
+recording_transport::recording_transport(
+  transport& inner,
+  const std::string& path) :
+    inner_(inner),
+    file_(path, std::ios::binary | std::ios::app)
+{
+  if (!file_)
+  {
+    throw std::runtime_error("Could not open recording " + path);
+  }
+}
+
+mastodonpp::answer_type recording_transport::get(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  mastodonpp::answer_type answer = inner_.get(endpoint, parameters);
+  record("GET", endpoint, answer);
+
+  return answer;
+}
+
+mastodonpp::answer_type recording_transport::post(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  mastodonpp::answer_type answer = inner_.post(endpoint, parameters);
+  record("POST", endpoint, answer);
+
+  return answer;
+}
+
+std::future<mastodonpp::answer_type> recording_transport::getAsync(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return recordLater("GET", endpoint, inner_.getAsync(endpoint, parameters));
+}
+
+std::future<mastodonpp::answer_type> recording_transport::postAsync(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap& parameters)
+{
+  return recordLater("POST", endpoint, inner_.postAsync(endpoint, parameters));
+}
+
+std::future<mastodonpp::answer_type> recording_transport::recordLater(
+  const char* method,
+  const mastodonpp::API::endpoint_type& endpoint,
+  std::future<mastodonpp::answer_type> pending)
+{
+  // Deferred, so the answer is recorded by whichever thread calls get().
+  return std::async(
+    std::launch::deferred,
+    [this, method, endpoint, pending = std::move(pending)] () mutable {
+      mastodonpp::answer_type answer = pending.get();
+      record(method, endpoint, answer);
+
+      return answer;
+    });
+}
+
+void recording_transport::record(
+  const char* method,
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::answer_type& answer)
+{
+  if (answer.curl_error_code != 0)
+  {
+    // Nothing came back from the server, so there is nothing to replay.
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(fileMutex_);
+
+  file_ << method << " " << mastodonpp::API{endpoint}.to_string_view() << " "
+    << answer.http_status << " " << answer.headers.size() << " "
+    << answer.body.size() << "\n"
+    << answer.headers << answer.body << "\n";
+
+  file_.flush();
+}
+
+replay_transport::replay_transport(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    throw std::runtime_error("Could not open recording " + path);
+  }
+
+  std::string method;
+  std::string endpoint;
+  int status;
+  std::size_t headerSize;
+  std::size_t bodySize;
+
+  while (file >> method >> endpoint >> status >> headerSize >> bodySize)
+  {
+    file.ignore(1);
+
+    mastodonpp::answer_type answer;
+    answer.http_status = status;
+    answer.headers.resize(headerSize);
+    answer.body.resize(bodySize);
+
+    if (!file.read(&answer.headers[0], headerSize)
+      || !file.read(&answer.body[0], bodySize))
+    {
+      throw std::runtime_error("Recording is truncated: " + path);
+    }
+
+    file.ignore(1);
+
+    responses_[method + " " + endpoint].answers.push_back(std::move(answer));
+  }
+}
+
+mastodonpp::answer_type replay_transport::get(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap&)
+{
+  return next("GET", endpoint, "[]");
+}
+
+mastodonpp::answer_type replay_transport::post(
+  const mastodonpp::API::endpoint_type& endpoint,
+  const mastodonpp::parametermap&)
+{
+  return next("POST", endpoint, "{}");
+}
+
+std::size_t replay_transport::remaining(
+  const std::string& method,
+  const mastodonpp::API::endpoint_type& endpoint)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = responses_.find(endpointKey(method, endpoint));
+
+  return (it == std::end(responses_))
+    ? 0
+    : it->second.answers.size() - it->second.next;
+}
+
+void replay_transport::rewind()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (auto& [key, recorded] : responses_)
+  {
+    recorded.next = 0;
+  }
+}
+
+mastodonpp::answer_type replay_transport::next(
+  const std::string& method,
+  const mastodonpp::API::endpoint_type& endpoint,
+  const char* fallback)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  auto it = responses_.find(endpointKey(method, endpoint));
+  if (it == std::end(responses_)
+    || it->second.next == it->second.answers.size())
+  {
+    mastodonpp::answer_type answer;
+    answer.http_status = 200;
+    answer.body = fallback;
+
+    return answer;
+  }
+
+  // Copied rather than moved, so that the recording can be rewound.
+  return it->second.answers[it->second.next++];
+}
@@ -0,0 +1,146 @@
+#ifndef TRANSPORT_H_1D5C8B3F
+#define TRANSPORT_H_1D5C8B3F
+
+#include <cstddef>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <mastodonpp/mastodonpp.hpp>
+
+// Where requests to the instance end up. Everything above this (the
+// scheduler, the timeline, follower syncing) only talks to this interface,
+// so a live connection can be swapped for a recording. Implementations must
+// accept requests from more than one thread at a time.
+class transport {
+public:
+
+  virtual ~transport() = default;
+
+  virtual mastodonpp::answer_type get(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) = 0;
+
+  virtual mastodonpp::answer_type post(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) = 0;
+
+  // Starts a request without waiting for it. The parameters are copied
+  // before this returns. Transports that cannot overlap requests simply
+  // perform them here and return a future that is already ready.
+  virtual std::future<mastodonpp::answer_type> getAsync(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters);
+
+  virtual std::future<mastodonpp::answer_type> postAsync(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters);
+};
+
+// Sends requests to a live instance, one at a time.
+class connection_transport : public transport {
+public:
+
+  explicit connection_transport(mastodonpp::Connection& connection);
+
+  mastodonpp::answer_type get(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  mastodonpp::answer_type post(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+private:
+
+  mastodonpp::Connection& connection_;
+  std::mutex mutex_;
+};
+
+// Passes requests through to another transport and appends every response
+// to a file that replay_transport can read back.
+class recording_transport : public transport {
+public:
+
+  recording_transport(transport& inner, const std::string& path);
+
+  mastodonpp::answer_type get(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  mastodonpp::answer_type post(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  std::future<mastodonpp::answer_type> getAsync(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  std::future<mastodonpp::answer_type> postAsync(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+private:
+
+  std::future<mastodonpp::answer_type> recordLater(
+    const char* method,
+    const mastodonpp::API::endpoint_type& endpoint,
+    std::future<mastodonpp::answer_type> pending);
+
+  void record(
+    const char* method,
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::answer_type& answer);
+
+  transport& inner_;
+  std::mutex fileMutex_;
+  std::ofstream file_;
+};
+
+// Answers requests from a recording, without any network access. Responses
+// are handed out in recorded order per method and endpoint, so the same
+// sequence of requests always gets the same answers. Once a GET endpoint
+// runs out it returns empty pages; POSTs that were never recorded succeed
+// with an empty object.
+class replay_transport : public transport {
+public:
+
+  explicit replay_transport(const std::string& path);
+
+  mastodonpp::answer_type get(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  mastodonpp::answer_type post(
+    const mastodonpp::API::endpoint_type& endpoint,
+    const mastodonpp::parametermap& parameters) override;
+
+  // How many recorded responses to this method and endpoint have not been
+  // handed out yet.
+  std::size_t remaining(
+    const std::string& method,
+    const mastodonpp::API::endpoint_type& endpoint);
+
+  // Starts handing out every recorded response from the beginning again,
+  // without reading the file a second time.
+  void rewind();
+
+private:
+
+  mastodonpp::answer_type next(
+    const std::string& method,
+    const mastodonpp::API::endpoint_type& endpoint,
+    const char* fallback);
+
+  struct recorded_responses {
+    std::vector<mastodonpp::answer_type> answers;
+    std::size_t next = 0;
+  };
+
+  std::mutex mutex_;
+  std::map<std::string, recorded_responses> responses_;
+};
+
+#endif /* end of include guard: TRANSPORT_H_1D5C8B3F */
@@ -0,0 +1,192 @@
+#include "trigger_matcher.h"
+#include <deque>
+#include <stdexcept>
+#include "normalizer.h"
+
+// Fed before, between and after tokens. Normalized tokens never contain it,
+// so a phrase wrapped in it can only match whole tokens.
+const unsigned char SEPARATOR = ' ';
+
+namespace {
+
+  const std::vector<std::string> DEFAULT_TRIGGERS = {"I'm", "I am"};
+
+  // A byte trie over the separator-wrapped phrases, before failure links.
+  struct trie_node {
+    std::vector<std::pair<std::uint8_t, std::uint32_t>> children;
+    std::uint32_t fail = 0;
+    std::vector<std::uint32_t> outputs;
+  };
+
+  std::uint32_t findChild(const trie_node& node, std::uint8_t byteClass)
+  {
+    for (const auto& [childClass, child] : node.children)
+    {
+      if (childClass == byteClass)
+      {
+        return child;
+      }
+    }
+
+    return 0;
+  }
+
+}
+
+trigger_matcher::trigger_matcher() : trigger_matcher(DEFAULT_TRIGGERS)
+{
+}
+
+trigger_matcher::trigger_matcher(
+  const std::vector<std::string>& phrases) :
+    phrases_(phrases)
+{
+  // Phrases are matched in the same form as the posts.
+  normalizer canonicalize;
+  std::vector<std::string> patterns;
+
+  for (const std::string& phrase : phrases_)
+  {
+    const std::vector<std::string_view>& tokens =
+      canonicalize.normalize(phrase);
+
+    std::string pattern(1, SEPARATOR);
+    bool hasLetters = false;
+
+    for (std::string_view token : tokens)
+    {
+      pattern.append(token);
+      pattern.push_back(SEPARATOR);
+
+      hasLetters = hasLetters || !token.empty();
+    }
+
+    if (!hasLetters)
+    {
+      throw std::invalid_argument("Trigger phrase has no words: " + phrase);
+    }
+
+    for (unsigned char byte : pattern)
+    {
+      if (byteClass_[byte] == 0)
+      {
+        if (classCount_ == byteClass_.size())
+        {
+          throw std::invalid_argument(
+            "Too many distinct bytes in trigger phrases");
+        }
+
+        byteClass_[byte] = classCount_++;
+      }
+    }
+
+    patterns.push_back(std::move(pattern));
+    tokenCounts_.push_back(tokens.size());
+  }
+
+  std::vector<trie_node> trie(1);
+
+  for (std::uint32_t i = 0; i < patterns.size(); i++)
+  {
+    std::uint32_t state = 0;
+
+    for (unsigned char byte : patterns[i])
+    {
+      std::uint32_t child = findChild(trie[state], byteClass_[byte]);
+
+      if (child == 0)
+      {
+        child = trie.size();
+        trie[state].children.emplace_back(byteClass_[byte], child);
+        trie.emplace_back();
+      }
+
+      state = child;
+    }
+
+    trie[state].outputs.push_back(i);
+  }
+
+  // Breadth first, so that every failure target is finished before the
+  // states that fall back to it.
+  transitions_.assign(trie.size() * classCount_, 0);
+
+  std::deque<std::uint32_t> queue;
+  for (const auto& [byteClass, child] : trie[0].children)
+  {
+    transitions_[byteClass] = child;
+    queue.push_back(child);
+  }
+
+  while (!queue.empty())
+  {
+    std::uint32_t state = queue.front();
+    queue.pop_front();
+
+    trie_node& node = trie[state];
+    const trie_node& fallback = trie[node.fail];
+
+    node.outputs.insert(
+      std::end(node.outputs),
+      std::begin(fallback.outputs),
+      std::end(fallback.outputs));
+
+    for (std::size_t c = 0; c < classCount_; c++)
+    {
+      transitions_[state * classCount_ + c] =
+        transitions_[node.fail * classCount_ + c];
+    }
+
+    for (const auto& [byteClass, child] : node.children)
+    {
+      trie[child].fail = transitions_[node.fail * classCount_ + byteClass];
+      transitions_[state * classCount_ + byteClass] = child;
+
+      queue.push_back(child);
+    }
+  }
+
+  for (const trie_node& node : trie)
+  {
+    outputStart_.push_back(outputs_.size());
+    outputs_.insert(
+      std::end(outputs_),
+      std::begin(node.outputs),
+      std::end(node.outputs));
+  }
+
+  outputStart_.push_back(outputs_.size());
+}
+
+void trigger_matcher::scan(
+  const std::vector<std::string_view>& tokens,
+  std::vector<trigger_match>& matches) const
+{
+  std::uint32_t state = step(0, SEPARATOR);
+
+  for (std::size_t i = 0; i < tokens.size(); i++)
+  {
+    for (unsigned char byte : tokens[i])
+    {
+      state = step(state, byte);
+    }
+
+    // Every phrase ends in a separator, so this is the only place a match
+    // can complete.
+    state = step(state, SEPARATOR);
+    report(state, i + 1, matches);
+  }
+}
+
+void trigger_matcher::report(
+  std::uint32_t state,
+  std::size_t next,
+  std::vector<trigger_match>& matches) const
+{
+  for (std::uint32_t i = outputStart_[state]; i < outputStart_[state + 1]; i++)
+  {
+    std::uint32_t trigger = outputs_[i];
+
+    matches.push_back({trigger, next - tokenCounts_[trigger], next});
+  }
+}
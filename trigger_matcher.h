@@ -0,0 +1,73 @@
+#ifndef TRIGGER_MATCHER_H_E16A0C57
+#define TRIGGER_MATCHER_H_E16A0C57
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct trigger_match {
+  // Index of the phrase in the table the matcher was built from.
+  std::size_t trigger;
+
+  // Token offsets: the phrase covers [start, next), and next is the first
+  // word after it (which may be one past the end).
+  std::size_t start;
+  std::size_t next;
+};
+
+// Finds trigger phrases like "I'm" or "I am" in normalized posts. The
+// phrases are run through the normalizer and compiled into one
+// Aho-Corasick automaton, expanded to a full transition table, so a scan
+// is a single table lookup per byte of the post however many phrases
+// there are. Phrases only match whole tokens. Scanning does not modify the
+// matcher, so one can be shared between threads.
+class trigger_matcher {
+public:
+
+  // Uses the default phrases, "I'm" and "I am".
+  trigger_matcher();
+
+  explicit trigger_matcher(const std::vector<std::string>& phrases);
+
+  // Appends every occurrence of every phrase in tokens (as returned by
+  // normalizer::normalize) to matches, ordered by where they end.
+  void scan(
+    const std::vector<std::string_view>& tokens,
+    std::vector<trigger_match>& matches) const;
+
+  const std::string& getPhrase(std::size_t trigger) const
+  {
+    return phrases_[trigger];
+  }
+
+private:
+
+  std::uint32_t step(std::uint32_t state, unsigned char byte) const
+  {
+    return transitions_[state * classCount_ + byteClass_[byte]];
+  }
+
+  void report(
+    std::uint32_t state,
+    std::size_t next,
+    std::vector<trigger_match>& matches) const;
+
+  std::vector<std::string> phrases_;
+  std::vector<std::size_t> tokenCounts_;
+
+  // Bytes that never appear in a phrase share class 0, which keeps the
+  // table small.
+  std::array<std::uint8_t, 256> byteClass_ {};
+  std::size_t classCount_ = 1;
+  std::vector<std::uint32_t> transitions_;
+
+  // The phrases ending at each state, including through failure links, as
+  // ranges into outputs_.
+  std::vector<std::uint32_t> outputStart_;
+  std::vector<std::uint32_t> outputs_;
+};
+
+#endif /* end of include guard: TRIGGER_MATCHER_H_E16A0C57 */